@@ -15,10 +15,8 @@ public:
 
   void enter() const override {}
   void exit() const override {}
-  void act(float dt, flecs::world &ecs, flecs::entity entity) const override
-  {
-    sm->act(dt, ecs, entity);
-  }
+  void act(float, flecs::world &, flecs::entity) const override {}
+  const StateMachine *nested() const override { return sm; }
 };
 
 class AttackEnemyState : public State
@@ -154,18 +152,19 @@ public:
   }
 };
 
-class MoveToPosState : public State
+// reads the position from the CraftsmanConsts of the entity, so one state serves every craftsman
+class MoveToCraftsmanPosState : public State
 {
-  int x, y;
+  Position CraftsmanConsts::*target;
 public:
-  MoveToPosState(int x, int y) : x(x), y(y) {}
+  MoveToCraftsmanPosState(Position CraftsmanConsts::*target) : target(target) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
+  void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity entity) const override
   {
-    entity.insert([&](Action &a, const Position &pos)
+    entity.insert([&](Action &a, const Position &pos, const CraftsmanConsts &consts)
     {
-      a.action = move_towards(pos, Position{x, y});
+      a.action = move_towards(pos, consts.*target);
     });
   }
 };
@@ -359,17 +358,17 @@ public:
   }
 };
 
-class ReachPosTransition : public StateTransition
+class ReachCraftsmanPosTransition : public StateTransition
 {
-  int x, y;
+  Position CraftsmanConsts::*target;
 public:
-  ReachPosTransition(int x, int y) : x(x), y(y) {};
-  bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
+  ReachCraftsmanPosTransition(Position CraftsmanConsts::*target) : target(target) {}
+  bool isAvailable(flecs::world &/*ecs*/, flecs::entity entity) const override
   {
     bool reached = false;
-    entity.get([&](const Position &pos, const Team& t)
+    entity.get([&](const Position &pos, const CraftsmanConsts &consts)
     {
-      reached = (pos == Position{x, y});
+      reached = (pos == consts.*target);
     });
     return reached;
   }
@@ -512,9 +511,9 @@ State *create_heal_player_state()
   return new HealPlayerState();
 }
 
-State *create_move_to_pos_state(int x, int y)
+State *create_move_to_craftsman_pos_state(Position CraftsmanConsts::*pos)
 {
-  return new MoveToPosState(x, y);
+  return new MoveToCraftsmanPosState(pos);
 }
 
 State *create_craft_state()
@@ -589,9 +588,9 @@ StateTransition *create_can_split_transition()
   return new CanSplitTransition();
 }
 
-StateTransition *create_reach_pos_transition(int x, int y)
+StateTransition *create_reach_craftsman_pos_transition(Position CraftsmanConsts::*pos)
 {
-  return new ReachPosTransition(x, y);
+  return new ReachCraftsmanPosTransition(pos);
 }
 
 StateTransition *create_craftsman_hungry_transition(float sleepThres, float hungerThres)
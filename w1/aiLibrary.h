@@ -1,6 +1,7 @@
 #pragma once
 
 #include "stateMachine.h"
+#include "ecsTypes.h"
 
 // states
 State *create_sm_state(StateMachine *sm);
@@ -9,7 +10,8 @@ State *create_move_to_enemy_state();
 State *create_move_to_player_state();
 State *create_heal_player_state();
 State *create_split_state();
-State *create_move_to_pos_state(int x, int y);
+// pos is one of the places in the CraftsmanConsts of the entity
+State *create_move_to_craftsman_pos_state(Position CraftsmanConsts::*pos);
 State *create_eat_state();
 State *create_sleep_state();
 State *create_craft_state();
@@ -26,7 +28,7 @@ StateTransition *create_hitpoints_less_than_transition(float thres);
 StateTransition *create_player_hitpoints_less_than_transition(float thres);
 StateTransition *create_player_available_transition(float dist);
 StateTransition *create_can_split_transition();
-StateTransition *create_reach_pos_transition(int x, int y);
+StateTransition *create_reach_craftsman_pos_transition(Position CraftsmanConsts::*pos);
 StateTransition *create_craftsman_sleepy_transition(float sleepThres);
 StateTransition *create_craftsman_hungry_transition(float sleepThres, float hungerThres);
 StateTransition *create_craftsman_happy_transition(float sleepThres, float hungerThres);
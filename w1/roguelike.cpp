@@ -3,10 +3,25 @@
 #include "raylib.h"
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "occupancyIndex.h"
+
+// Builds the definition on first use, every entity of the archetype shares it and
+// spawning only sets a StateMachineInstance.
+template<typename Callable>
+static const StateMachine *shared_sm(Callable build)
+{
+  static const StateMachine *sm = [&]()
+  {
+    StateMachine *res = new StateMachine();
+    build(*res);
+    return res;
+  }();
+  return sm;
+}
 
 static void add_patrol_attack_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     int patrol = sm.addState(create_patrol_state(3.f));
     int moveToEnemy = sm.addState(create_move_to_enemy_state());
@@ -21,44 +36,44 @@ static void add_patrol_attack_flee_sm(flecs::entity entity)
                      patrol, fleeFromEnemy);
 
     sm.addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, patrol);
-  });
+  })});
 }
 
 static void add_patrol_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     int patrol = sm.addState(create_patrol_state(3.f));
     int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
 
     sm.addTransition(create_enemy_available_transition(3.f), patrol, fleeFromEnemy);
     sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), fleeFromEnemy, patrol);
-  });
+  })});
 }
 
 static void add_attack_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     sm.addState(create_move_to_enemy_state());
-  });
+  })});
 }
 
 static void add_slime_sm(flecs::entity entity)
 {
-  entity.insert([&](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     int moveToEnemy = sm.addState(create_move_to_enemy_state());
     int split = sm.addState(create_split_state());
 
     sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(80.f), create_can_split_transition()), moveToEnemy, split);
     sm.addTransition(create_always_transition(), split, moveToEnemy);
-  });
+  })});
 }
 
 static void add_archer_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     int moveToEnemy = sm.addState(create_move_to_enemy_state());
     int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
@@ -69,12 +84,12 @@ static void add_archer_sm(flecs::entity entity)
 
     sm.addTransition(create_enemy_available_transition(3.f), attackEnemy, fleeFromEnemy);
     sm.addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, moveToEnemy);
-  });
+  })});
 }
 
 static void add_healer_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     int moveToPlayer = sm.addState(create_move_to_player_state());
     int moveToEnemy = sm.addState(create_move_to_enemy_state());
@@ -87,39 +102,39 @@ static void add_healer_sm(flecs::entity entity)
       moveToPlayer, heal);
     sm.addTransition(create_negate_transition(create_and_transition(create_player_available_transition(1.f), create_player_hitpoints_less_than_transition(70.f))),
       heal, moveToPlayer);
-  });
+  })});
 }
 
 static void add_craftsman_sm(flecs::entity entity)
 {
-  entity.insert([](StateMachine& sm, const CraftsmanConsts consts)
+  entity.set(StateMachineInstance{shared_sm([](StateMachine &sm)
   {
     StateMachine* craft_sm = new StateMachine();
     {
-      int goToCraft = craft_sm->addState(create_move_to_pos_state(consts.craftPos.x, consts.craftPos.y));
+      int goToCraft = craft_sm->addState(create_move_to_craftsman_pos_state(&CraftsmanConsts::craftPos));
       int craft = craft_sm->addState(create_craft_state());
-      int goToSell = craft_sm->addState(create_move_to_pos_state(consts.sellPos.x, consts.sellPos.y));
+      int goToSell = craft_sm->addState(create_move_to_craftsman_pos_state(&CraftsmanConsts::sellPos));
       int sell = craft_sm->addState(create_sell_state());
 
       int craftTime = 2;
       craft_sm->addTransition(create_negate_transition(create_craftsman_crafting_transition(craftTime)), craft, goToSell);
-      craft_sm->addTransition(create_reach_pos_transition(consts.sellPos.x, consts.sellPos.y), goToSell, sell);
+      craft_sm->addTransition(create_reach_craftsman_pos_transition(&CraftsmanConsts::sellPos), goToSell, sell);
       craft_sm->addTransition(create_always_transition(), sell, goToCraft);
-      craft_sm->addTransition(create_reach_pos_transition(consts.craftPos.x, consts.craftPos.y), goToCraft, craft);
+      craft_sm->addTransition(create_reach_craftsman_pos_transition(&CraftsmanConsts::craftPos), goToCraft, craft);
     }
     // main (hierarchical) SM
     {
       // states
-      int goToEat = sm.addState(create_move_to_pos_state(consts.eatPos.x, consts.eatPos.y));
+      int goToEat = sm.addState(create_move_to_craftsman_pos_state(&CraftsmanConsts::eatPos));
       int eat = sm.addState(create_eat_state());
-      int goToSleep = sm.addState(create_move_to_pos_state(consts.sleepPos.x, consts.sleepPos.y));
+      int goToSleep = sm.addState(create_move_to_craftsman_pos_state(&CraftsmanConsts::sleepPos));
       int sleep = sm.addState(create_sleep_state());
       int craftSM = sm.addState(create_sm_state(craft_sm));
       // transitions
       int hungerThres = 24;
       int sleepThres = 32;
-      sm.addTransition(create_reach_pos_transition(consts.eatPos.x, consts.eatPos.y), goToEat, eat);
-      sm.addTransition(create_reach_pos_transition(consts.sleepPos.x, consts.sleepPos.y), goToSleep, sleep);
+      sm.addTransition(create_reach_craftsman_pos_transition(&CraftsmanConsts::eatPos), goToEat, eat);
+      sm.addTransition(create_reach_craftsman_pos_transition(&CraftsmanConsts::sleepPos), goToSleep, sleep);
       sm.addTransition(create_craftsman_hungry_transition(sleepThres, hungerThres), craftSM, goToEat);
       sm.addTransition(create_craftsman_happy_transition(sleepThres, hungerThres), eat, craftSM);
       sm.addTransition(create_craftsman_sleepy_transition(sleepThres), craftSM, goToSleep);
@@ -127,7 +142,7 @@ static void add_craftsman_sm(flecs::entity entity)
       sm.addTransition(create_craftsman_hungry_transition(sleepThres, hungerThres), sleep, goToEat);
       sm.addTransition(create_craftsman_sleepy_transition(sleepThres), eat, goToSleep);
     }
-  });
+  })});
 }
 
 static flecs::entity create_monster(flecs::world &ecs, int x, int y, Color color)
@@ -139,7 +154,6 @@ static flecs::entity create_monster(flecs::world &ecs, int x, int y, Color color
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
     .set(Color{color})
-    .set(StateMachine{})
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f});
@@ -154,7 +168,6 @@ static flecs::entity create_slime(flecs::world &ecs, int x, int y, Color color,
     .set(Hitpoints{160.f})
     .set(Action{EA_NOP})
     .set(Color{color})
-    .set(StateMachine{})
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f})
@@ -170,7 +183,6 @@ static flecs::entity create_archer(flecs::world &ecs, int x, int y, Color color)
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
     .set(Color{color})
-    .set(StateMachine{})
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{0.f})
@@ -186,7 +198,6 @@ static flecs::entity create_healer(flecs::world &ecs, int x, int y, Color color)
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
     .set(Color{color})
-    .set(StateMachine{})
     .set(Team{0})
     .set(NumActions{1, 0})
     .set(MeleeDamage{30.f})
@@ -344,6 +355,7 @@ static void process_actions(flecs::world &ecs)
 {
   static auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
   static auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
+  static OccupancyIndex occupancy;
   static auto slimeSplit = ecs.query<IsSlime, const Action, const Position>();
   static auto processHeals = ecs.query<const Action, const Position, Heal, const Team>();
   static auto processRangedAttacks = ecs.query<const Action, const Position, const RangedAttack, const Team>();
@@ -352,23 +364,31 @@ static void process_actions(flecs::world &ecs)
   // Process all actions
   ecs.defer([&]
   {
+    occupancy.clear();
+    checkAttacks.each([&](flecs::entity entity, const MovePos &mpos, Hitpoints &hp, const Team &team)
+    {
+      occupancy.add(mpos, {entity, &hp, team.team});
+    });
     processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
     {
       Position nextPos = move_pos(pos, a.action);
       bool blocked = false;
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      occupancy.each(nextPos, [&](OccupancyIndex::Occupant &occ)
       {
-        if (entity != enemy && epos == nextPos)
+        if (occ.entity != entity)
         {
           blocked = true;
-          if (team.team != enemy_team.team)
-            hp.hitpoints -= dmg.damage;
+          if (team.team != occ.team)
+            occ.hp->hitpoints -= dmg.damage;
         }
       });
       if (blocked)
         a.action = EA_NOP;
       else
+      {
+        occupancy.move(entity, mpos, nextPos);
         mpos = nextPos;
+      }
     });
     processHeals.each([&](const Action& a, const Position& pos, Heal& heal, const Team& team)
     {
@@ -466,7 +486,7 @@ static void process_actions(flecs::world &ecs)
 
 void process_turn(flecs::world &ecs)
 {
-  static auto stateMachineAct = ecs.query<StateMachine>();
+  static auto stateMachineAct = ecs.query<StateMachineInstance>();
   if (is_player_acted(ecs))
   {
     if (upd_player_actions_count(ecs))
@@ -474,7 +494,7 @@ void process_turn(flecs::world &ecs)
       // Plan action for NPCs
       ecs.defer([&]
       {
-        stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
+        stateMachineAct.each([&](flecs::entity e, StateMachineInstance &sm)
         {
           sm.act(0.f, ecs, e);
         });
@@ -1,4 +1,6 @@
 #include "stateMachine.h"
+#include <algorithm>
+#include <cassert>
 
 StateMachine::~StateMachine()
 {
@@ -11,8 +13,9 @@ StateMachine::~StateMachine()
   transitions.clear();
 }
 
-void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
+void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity, StateMachineInstance &inst, size_t level) const
 {
+  int &curStateIdx = inst.curStateIdx[level];
   if (curStateIdx < states.size())
   {
     for (const std::pair<StateTransition*, int> &transition : transitions[curStateIdx])
@@ -23,14 +26,33 @@ void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
         states[curStateIdx]->enter();
         break;
       }
-    states[curStateIdx]->act(dt, ecs, entity);
+    const StateMachine *nested = states[curStateIdx]->nested();
+    if (nested)
+    {
+      // addState keeps hierarchies within max_sm_levels, a deeper one would run out of instance slots
+      assert(level + 1 < max_sm_levels && "state machines nest deeper than max_sm_levels");
+      if (level + 1 < max_sm_levels)
+        nested->act(dt, ecs, entity, inst, level + 1);
+    }
+    else
+      states[curStateIdx]->act(dt, ecs, entity);
   }
   else
     curStateIdx = 0;
 }
 
+size_t StateMachine::depth() const
+{
+  size_t nestedDepth = 0;
+  for (const State *state : states)
+    if (const StateMachine *nested = state->nested())
+      nestedDepth = std::max(nestedDepth, nested->depth());
+  return nestedDepth + 1;
+}
+
 int StateMachine::addState(State *st)
 {
+  assert((!st->nested() || st->nested()->depth() < max_sm_levels) && "state machines nest deeper than max_sm_levels");
   int idx = states.size();
   states.push_back(st);
   transitions.push_back(std::vector<std::pair<StateTransition*, int>>());
@@ -41,4 +63,3 @@ void StateMachine::addTransition(StateTransition *trans, int from, int to)
 {
   transitions[from].push_back(std::make_pair(trans, to));
 }
-
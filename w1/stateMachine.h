@@ -2,12 +2,17 @@
 #include <vector>
 #include <flecs.h>
 
+class StateMachine;
+
 class State
 {
 public:
+  virtual ~State() {}
   virtual void enter() const = 0;
   virtual void exit() const = 0;
   virtual void act(float dt, flecs::world &ecs, flecs::entity entity) const = 0;
+  // hierarchical states return their machine, it acts one level down instead of act
+  virtual const StateMachine *nested() const { return nullptr; }
 };
 
 class StateTransition
@@ -17,28 +22,50 @@ public:
   virtual bool isAvailable(flecs::world &ecs, flecs::entity entity) const = 0;
 };
 
+constexpr size_t max_sm_levels = 4;
+
+struct StateMachineInstance;
+
+// Immutable once built and shared by every entity of an archetype, entities only keep
+// a StateMachineInstance with their current states.
 class StateMachine
 {
-  int curStateIdx = 0;
   std::vector<State*> states;
   std::vector<std::vector<std::pair<StateTransition*, int>>> transitions;
 public:
   StateMachine() = default;
-  StateMachine(const StateMachine &sm) = default;
+  StateMachine(const StateMachine &sm) = delete;
   StateMachine(StateMachine &&sm) = default;
 
   ~StateMachine();
 
-  StateMachine &operator=(const StateMachine &sm) = default;
+  StateMachine &operator=(const StateMachine &sm) = delete;
   StateMachine &operator=(StateMachine &&sm) = default;
 
 
-  void act(float dt, flecs::world &ecs, flecs::entity entity);
+  // level is the depth of this machine in the hierarchy, inst keeps one current state per level
+  void act(float dt, flecs::world &ecs, flecs::entity entity, StateMachineInstance &inst, size_t level) const;
 
+  // levels this machine spans, itself included
+  size_t depth() const;
+
+  // nested machines of st may span at most max_sm_levels - 1 levels
   int addState(State *st);
   void addTransition(StateTransition *trans, int from, int to);
 };
 
+struct StateMachineInstance
+{
+  const StateMachine *sm = nullptr;
+  int curStateIdx[max_sm_levels] = {};
+
+  void act(float dt, flecs::world &ecs, flecs::entity entity)
+  {
+    if (sm)
+      sm->act(dt, ecs, entity, *this, 0);
+  }
+};
+
 class ComplexState : public State
 {
   StateMachine *sm;
@@ -48,8 +75,6 @@ public:
 
   void enter() const override {}
   void exit() const override {}
-  void act(float dt, flecs::world& ecs, flecs::entity entity) const override
-  {
-    sm->act(dt, ecs, entity);
-  }
+  void act(float, flecs::world&, flecs::entity) const override {}
+  const StateMachine *nested() const override { return sm; }
 };
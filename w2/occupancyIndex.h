@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// tile -> entities standing (or about to stand) on it, keyed by MovePos
+// rebuilt once per turn and updated incrementally as movers advance
+class OccupancyIndex
+{
+public:
+  struct Occupant
+  {
+    flecs::entity entity;
+    Hitpoints *hp = nullptr; // stable while structural changes are deferred
+    int team = 0;
+  };
+
+  void clear()
+  {
+    // keep buckets and vectors around, next turn will most likely reuse them
+    for (auto &cell : cells)
+      cell.second.clear();
+  }
+
+  template<typename T>
+  void add(const T &pos, const Occupant &occ)
+  {
+    cells[key(pos)].push_back(occ);
+  }
+
+  template<typename T, typename U>
+  void move(flecs::entity entity, const T &from, const U &to)
+  {
+    auto itf = cells.find(key(from));
+    if (itf == cells.end())
+      return;
+    std::vector<Occupant> &occupants = itf->second;
+    for (size_t i = 0; i < occupants.size(); ++i)
+      if (occupants[i].entity == entity)
+      {
+        Occupant occ = occupants[i];
+        occupants[i] = occupants.back();
+        occupants.pop_back();
+        add(to, occ);
+        return;
+      }
+  }
+
+  template<typename T, typename Callable>
+  void each(const T &pos, Callable c)
+  {
+    auto itf = cells.find(key(pos));
+    if (itf == cells.end())
+      return;
+    for (Occupant &occ : itf->second)
+      c(occ);
+  }
+
+private:
+  template<typename T>
+  static uint64_t key(const T &pos)
+  {
+    return (uint64_t(uint32_t(pos.y)) << 32) | uint64_t(uint32_t(pos.x));
+  }
+
+  std::unordered_map<uint64_t, std::vector<Occupant>> cells;
+};
@@ -3,6 +3,7 @@
 #include "raylib.h"
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "occupancyIndex.h"
 #include "blackboard.h"
 #include "math.h"
 
@@ -264,6 +265,7 @@ static void process_actions(flecs::world &ecs)
   static auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
   static auto processHeals = ecs.query<Action, Hitpoints>();
   static auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
+  static OccupancyIndex occupancy;
   // Process all actions
   ecs.defer([&]
   {
@@ -276,26 +278,34 @@ static void process_actions(flecs::world &ecs)
       hp.hitpoints += 10.f;
 
     });
+    occupancy.clear();
+    checkAttacks.each([&](flecs::entity entity, const MovePos &mpos, Hitpoints &hp, const Team &team)
+    {
+      occupancy.add(mpos, {entity, &hp, team.team});
+    });
     processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
     {
       Position nextPos = move_pos(pos, a.action);
       bool blocked = false;
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      occupancy.each(nextPos, [&](OccupancyIndex::Occupant &occ)
       {
-        if (entity != enemy && epos == nextPos)
+        if (occ.entity != entity)
         {
           blocked = true;
-          if (team.team != enemy_team.team)
+          if (team.team != occ.team)
           {
             push_to_log(ecs, "damaged entity");
-            hp.hitpoints -= dmg.damage;
+            occ.hp->hitpoints -= dmg.damage;
           }
         }
       });
       if (blocked)
         a.action = EA_NOP;
       else
+      {
+        occupancy.move(entity, mpos, nextPos);
         mpos = nextPos;
+      }
     });
     // now move
     processActions.each([&](Action &a, Position &pos, MovePos &mpos, const MeleeDamage &, const Team&)
@@ -1,9 +1,10 @@
 #include "aiLibrary.h"
 #include <flecs.h>
 #include "ecsTypes.h"
-#include "raylib.h"
+#include "rng.h"
 #include "math.h"
 #include "aiUtils.h"
+#include "flatStateMachine.h"
 
 class AttackEnemyState : public State
 {
@@ -11,6 +12,8 @@ public:
   void enter() const override {}
   void exit() const override {}
   void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity /*entity*/) const override {}
+  bool idle() const override { return true; }
+  uint32_t compile(FlatFsmBuilder &builder) const override { return builder.add_state(FsmAct::Nop); }
 };
 
 class MoveToEnemyState : public State
@@ -25,6 +28,7 @@ public:
       a.action = move_towards(pos, enemy_pos);
     });
   }
+  uint32_t compile(FlatFsmBuilder &builder) const override { return builder.add_state(FsmAct::MoveToEnemy); }
 };
 
 class FleeFromEnemyState : public State
@@ -40,6 +44,7 @@ public:
       a.action = inverse_move(move_towards(pos, enemy_pos));
     });
   }
+  uint32_t compile(FlatFsmBuilder &builder) const override { return builder.add_state(FsmAct::FleeFromEnemy); }
 };
 
 class PatrolState : public State
@@ -58,10 +63,14 @@ public:
       else
       {
         // do a random walk
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1);
+        a.action = rng::range(EA_MOVE_START, EA_MOVE_END - 1);
       }
     });
   }
+  uint32_t compile(FlatFsmBuilder &builder) const override
+  {
+    return builder.add_state(FsmAct::Patrol, patrolDist);
+  }
 };
 
 class NopState : public State
@@ -70,6 +79,8 @@ public:
   void enter() const override {}
   void exit() const override {}
   void act(float/* dt*/, flecs::world &, flecs::entity) const override {}
+  bool idle() const override { return true; }
+  uint32_t compile(FlatFsmBuilder &builder) const override { return builder.add_state(FsmAct::Nop); }
 };
 
 class EnemyAvailableTransition : public StateTransition
@@ -79,20 +90,14 @@ public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
-    bool enemiesFound = false;
-    entity.get([&](const Position &pos, const Team &t)
-    {
-      enemiesQuery.each([&](const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        enemiesFound |= curDist <= triggerDist;
-      });
-    });
-    return enemiesFound;
+    return closest_enemy(ecs, entity).dist <= triggerDist;
+  }
+  uint32_t subscribe(Perception &perception) const override
+  {
+    perception.watch_radius(triggerDist);
+    return PE_ENEMY_RADIUS;
   }
+  void compile(FlatFsmBuilder &builder) const override { builder.emit(FsmOp::EnemyWithin, triggerDist); }
 };
 
 class HitpointsLessThanTransition : public StateTransition
@@ -109,6 +114,12 @@ public:
     });
     return hitpointsThresholdReached;
   }
+  uint32_t subscribe(Perception &perception) const override
+  {
+    perception.watch_hp(threshold);
+    return PE_HP_CROSSED;
+  }
+  void compile(FlatFsmBuilder &builder) const override { builder.emit(FsmOp::HpBelow, threshold); }
 };
 
 class EnemyReachableTransition : public StateTransition
@@ -118,6 +129,8 @@ public:
   {
     return false;
   }
+  uint32_t subscribe(Perception &) const override { return 0; }
+  void compile(FlatFsmBuilder &builder) const override { builder.emit(FsmOp::Const, 0.f); }
 };
 
 class NegateTransition : public StateTransition
@@ -131,6 +144,12 @@ public:
   {
     return !transition->isAvailable(ecs, entity);
   }
+  uint32_t subscribe(Perception &perception) const override { return transition->subscribe(perception); }
+  void compile(FlatFsmBuilder &builder) const override
+  {
+    transition->compile(builder);
+    builder.emit(FsmOp::Not);
+  }
 };
 
 class AndTransition : public StateTransition
@@ -149,6 +168,16 @@ public:
   {
     return lhs->isAvailable(ecs, entity) && rhs->isAvailable(ecs, entity);
   }
+  uint32_t subscribe(Perception &perception) const override
+  {
+    return lhs->subscribe(perception) | rhs->subscribe(perception);
+  }
+  void compile(FlatFsmBuilder &builder) const override
+  {
+    lhs->compile(builder);
+    rhs->compile(builder);
+    builder.emit(FsmOp::And);
+  }
 };
 
 
@@ -18,11 +18,19 @@ StateTransition *create_hitpoints_less_than_transition(float thres);
 StateTransition *create_negate_transition(StateTransition *in);
 StateTransition *create_and_transition(StateTransition *lhs, StateTransition *rhs);
 
-using utility_function = std::function<float(Blackboard&)>;
-
 BehNode *sequence(const std::vector<BehNode*> &nodes);
+// Compiled trees resume at the node left running on the previous tick instead of re-running the
+// nodes before it, guards are still checked on every tick unless the entity has a Perception and
+// none of the events a guard depends on fired. Falls back to a plain sequence when a higher
+// priority branch took over in between.
+BehNode *memory_sequence(const std::vector<BehNode*> &guards, const std::vector<BehNode*> &nodes);
 BehNode *selector(const std::vector<BehNode*> &nodes);
+// at most max_utility_options options, more assert. Release builds drop the rest so the fixed score
+// arrays of the trees can't overflow.
 BehNode *utility_selector(const std::vector<std::pair<BehNode*, utility_function>> &nodes);
+// same, but compiled trees score all entities of a batch at once
+BehNode *linear_utility_selector(const std::vector<std::pair<BehNode*, LinearUtility>> &nodes);
+LinearUtility linear_utility(float bias, const std::vector<std::pair<const char*, float>> &terms);
 
 BehNode *move_to_entity(flecs::entity entity, const char *bb_name);
 BehNode *is_low_hp(float thres);
@@ -31,3 +39,11 @@ BehNode *flee(flecs::entity entity, const char *bb_name);
 BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name);
 BehNode *patch_up(float thres);
 
+// Leaves of shared definitions, they don't touch any entity. Keys come from the names,
+// FlatBehTree::init_entity registers them and sets up patrols per entity, a virtual tree of the same
+// definition runs on that blackboard as well.
+BehNode *move_to_entity(const char *bb_name);
+BehNode *find_enemy(float dist, const char *bb_name);
+BehNode *flee(const char *bb_name);
+BehNode *patrol(float patrol_dist, const char *bb_name);
+
@@ -3,6 +3,7 @@
 #include "blackboard.h"
 #include <float.h>
 #include "math.h"
+#include "sensors.h"
 
 template<typename T, typename U>
 inline int move_towards(const T &from, const U &to)
@@ -22,29 +23,51 @@ inline int inverse_move(int move)
          move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
 }
 
-template<typename Callable>
-inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
+// Shared by all AI nodes. Has to be created on the main thread before decisions fan out
+// to worker stages, iterate it with .iter(ecs) so a stage world is used when one is passed in.
+inline flecs::query<const Position, const Team> &team_positions_query(flecs::world &ecs)
+{
+  static auto teamPositionsQuery = ecs.query<const Position, const Team>();
+  return teamPositionsQuery;
+}
+
+struct ClosestEnemy
+{
+  flecs::entity entity; // invalid without enemies
+  Position pos;
+  float dist = FLT_MAX;
+};
+
+// Read from the Sensors of the turn, entities without them scan every team.
+inline ClosestEnemy closest_enemy(flecs::world &ecs, flecs::entity entity)
 {
-  static auto enemiesQuery = ecs.query<const Position, const Team>();
-  entity.insert([&](const Position &pos, const Team &t, Action &a)
+  ClosestEnemy res;
+  if (entity.get([&](const Sensors &s) { res = ClosestEnemy{s.closestEnemy, s.closestEnemyPos, s.closestEnemyDist}; }))
+    return res;
+  auto &enemiesQuery = team_positions_query(ecs);
+  entity.get([&](const Position &pos, const Team &t)
   {
-    flecs::entity closestEnemy;
-    float closestDist = FLT_MAX;
-    Position closestPos;
-    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+    enemiesQuery.iter(ecs).each([&](flecs::entity enemy, const Position &epos, const Team &et)
     {
       if (t.team == et.team)
         return;
       float curDist = dist(epos, pos);
-      if (curDist < closestDist)
-      {
-        closestDist = curDist;
-        closestPos = epos;
-        closestEnemy = enemy;
-      }
+      if (curDist < res.dist)
+        res = ClosestEnemy{enemy, epos, curDist};
     });
-    if (ecs.is_valid(closestEnemy))
-      c(a, pos, closestPos);
+  });
+  return res;
+}
+
+template<typename Callable>
+inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
+{
+  const ClosestEnemy enemy = closest_enemy(ecs, entity);
+  if (!ecs.is_valid(enemy.entity))
+    return;
+  entity.insert([&](const Position &pos, Action &a)
+  {
+    c(a, pos, enemy.pos);
   });
 }
 
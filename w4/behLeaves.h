@@ -0,0 +1,19 @@
+#pragma once
+#include <flecs.h>
+#include "behaviourTree.h"
+#include "blackboard.h"
+
+// Leaf logic shared by the virtual nodes, the flat interpreter and the static trees.
+// Keys are blackboard keys from bb_key, the entity is expected to be mutable on ecs.
+namespace beh
+{
+  BehResult move_to_entity(flecs::entity entity, Blackboard &bb, size_t entityBb);
+  BehResult is_low_hp(flecs::entity entity, float thres);
+  BehResult find_enemy(flecs::world &ecs, flecs::entity entity, Blackboard &bb, float dist, size_t entityBb);
+  BehResult flee(flecs::entity entity, Blackboard &bb, size_t entityBb);
+  BehResult patrol(flecs::entity entity, Blackboard &bb, float patrol_dist, size_t pposBb);
+  BehResult patch_up(flecs::entity entity, float thres);
+
+  // patrol remembers where the entity started
+  void init_patrol(flecs::entity entity, Blackboard &bb, size_t pposBb);
+};
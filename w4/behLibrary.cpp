@@ -2,9 +2,12 @@
 #include "ecsTypes.h"
 #include "aiUtils.h"
 #include "math.h"
-#include "raylib.h"
+#include "rng.h"
 #include "blackboard.h"
+#include "behLeaves.h"
+#include "flatBehTree.h"
 #include <algorithm>
+#include <cassert>
 
 struct CompoundNode : public BehNode
 {
@@ -22,6 +25,16 @@ struct CompoundNode : public BehNode
     nodes.push_back(node);
     return *this;
   }
+
+  uint32_t compileAs(FlatOp op, FlatBehTreeBuilder &builder) const
+  {
+    const uint32_t idx = builder.add(op);
+    std::vector<uint32_t> kids;
+    for (const BehNode *node : nodes)
+      kids.push_back(node->compile(builder));
+    builder.link(idx, kids);
+    return idx;
+  }
 };
 
 struct Sequence : public CompoundNode
@@ -36,6 +49,36 @@ struct Sequence : public CompoundNode
     }
     return BEH_SUCCESS;
   }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return compileAs(FlatOp::Sequence, builder);
+  }
+};
+
+// The virtual tree has no per-tick state and re-walks it like a sequence of guards and nodes,
+// compiled trees resume at the running child.
+struct MemorySequence : public CompoundNode
+{
+  uint16_t guardCount = 0;
+
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
+  {
+    for (BehNode *node : nodes)
+    {
+      BehResult res = node->update(ecs, entity, bb);
+      if (res != BEH_SUCCESS)
+        return res;
+    }
+    return BEH_SUCCESS;
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    const uint32_t idx = compileAs(FlatOp::MemorySequence, builder);
+    builder.add_state(idx, guardCount);
+    return idx;
+  }
 };
 
 struct Selector : public CompoundNode
@@ -50,35 +93,151 @@ struct Selector : public CompoundNode
     }
     return BEH_FAIL;
   }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return compileAs(FlatOp::Selector, builder);
+  }
 };
 
 struct UtilitySelector : public BehNode
 {
   std::vector<std::pair<BehNode*, utility_function>> utilityNodes;
+  std::vector<LinearUtility> linear; // same options as utilityNodes when built from linear utilities
 
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    std::vector<std::pair<float, size_t>> utilityScores;
+    float scores[max_utility_options];
     for (size_t i = 0; i < utilityNodes.size(); ++i)
+      scores[i] = utilityNodes[i].second(bb);
+    return run_by_utility(scores, utilityNodes.size(), [&](size_t i)
     {
-      const float utilityScore = utilityNodes[i].second(bb);
-      utilityScores.push_back(std::make_pair(utilityScore, i));
-    }
-    std::sort(utilityScores.begin(), utilityScores.end(), [](auto &lhs, auto &rhs)
-    {
-      return lhs.first > rhs.first;
+      return utilityNodes[i].first->update(ecs, entity, bb);
     });
-    for (const std::pair<float, size_t> &node : utilityScores)
+  }
+
+  ~UtilitySelector()
+  {
+    for (auto &node : utilityNodes)
+      delete node.first;
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    const uint32_t idx = builder.add(FlatOp::UtilitySelector);
+    std::vector<uint32_t> kids;
+    std::vector<utility_function> utilities;
+    for (const auto &node : utilityNodes)
     {
-      size_t nodeIdx = node.second;
-      BehResult res = utilityNodes[nodeIdx].first->update(ecs, entity, bb);
-      if (res != BEH_FAIL)
-        return res;
+      kids.push_back(node.first->compile(builder));
+      utilities.push_back(node.second);
     }
-    return BEH_FAIL;
+    builder.link(idx, kids, utilities);
+    if (!linear.empty())
+      builder.add_linear_scores(idx, linear);
+    return idx;
   }
 };
 
+BehResult beh::move_to_entity(flecs::entity entity, Blackboard &bb, size_t entityBb)
+{
+  BehResult res = BEH_RUNNING;
+  entity.insert([&](Action &a, const Position &pos)
+  {
+    flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
+    if (!targetEntity.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    targetEntity.get([&](const Position &target_pos)
+    {
+      if (pos != target_pos)
+      {
+        a.action = move_towards(pos, target_pos);
+        res = BEH_RUNNING;
+      }
+      else
+        res = BEH_SUCCESS;
+    });
+  });
+  return res;
+}
+
+BehResult beh::is_low_hp(flecs::entity entity, float thres)
+{
+  BehResult res = BEH_SUCCESS;
+  entity.get([&](const Hitpoints &hp)
+  {
+    res = hp.hitpoints < thres ? BEH_SUCCESS : BEH_FAIL;
+  });
+  return res;
+}
+
+BehResult beh::find_enemy(flecs::world &ecs, flecs::entity entity, Blackboard &bb, float distance, size_t entityBb)
+{
+  const ClosestEnemy enemy = closest_enemy(ecs, entity);
+  if (!ecs.is_valid(enemy.entity) || enemy.dist > distance)
+    return BEH_FAIL;
+  bb.set<flecs::entity>(entityBb, enemy.entity);
+  return BEH_SUCCESS;
+}
+
+BehResult beh::flee(flecs::entity entity, Blackboard &bb, size_t entityBb)
+{
+  BehResult res = BEH_RUNNING;
+  entity.insert([&](Action &a, const Position &pos)
+  {
+    flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
+    if (!targetEntity.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    targetEntity.get([&](const Position &target_pos)
+    {
+      a.action = inverse_move(move_towards(pos, target_pos));
+    });
+  });
+  return res;
+}
+
+BehResult beh::patrol(flecs::entity entity, Blackboard &bb, float patrol_dist, size_t pposBb)
+{
+  BehResult res = BEH_RUNNING;
+  entity.insert([&](Action &a, const Position &pos)
+  {
+    Position patrolPos = bb.get<Position>(pposBb);
+    if (dist(pos, patrolPos) > patrol_dist)
+      a.action = move_towards(pos, patrolPos);
+    else
+      a.action = rng::range(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
+  });
+  return res;
+}
+
+void beh::init_patrol(flecs::entity entity, Blackboard &bb, size_t pposBb)
+{
+  bb.regKey<Position>(pposBb);
+  entity.get([&](const Position &pos)
+  {
+    bb.set<Position>(pposBb, pos);
+  });
+}
+
+BehResult beh::patch_up(flecs::entity entity, float thres)
+{
+  BehResult res = BEH_SUCCESS;
+  entity.insert([&](Action &a, Hitpoints &hp)
+  {
+    if (hp.hitpoints >= thres)
+      return;
+    res = BEH_RUNNING;
+    a.action = EA_HEAL_SELF;
+  });
+  return res;
+}
+
 struct MoveToEntity : public BehNode
 {
   size_t entityBb = size_t(-1); // wraps to 0xff...
@@ -86,30 +245,16 @@ struct MoveToEntity : public BehNode
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
+  explicit MoveToEntity(size_t key) : entityBb(key) {}
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.insert([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        if (pos != target_pos)
-        {
-          a.action = move_towards(pos, target_pos);
-          res = BEH_RUNNING;
-        }
-        else
-          res = BEH_SUCCESS;
-      });
-    });
-    return res;
+    return beh::move_to_entity(entity, bb, entityBb);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::MoveToEntity, 0.f, entityBb);
   }
 };
 
@@ -120,12 +265,12 @@ struct IsLowHp : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &) override
   {
-    BehResult res = BEH_SUCCESS;
-    entity.get([&](const Hitpoints &hp)
-    {
-      res = hp.hitpoints < threshold ? BEH_SUCCESS : BEH_FAIL;
-    });
-    return res;
+    return beh::is_low_hp(entity, threshold);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::IsLowHp, threshold);
   }
 };
 
@@ -137,34 +282,16 @@ struct FindEnemy : public BehNode
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
+  FindEnemy(float in_dist, size_t key) : entityBb(key), distance(in_dist) {}
+
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_FAIL;
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
-    entity.insert([&](const Position &pos, const Team &t)
-    {
-      flecs::entity closestEnemy;
-      float closestDist = FLT_MAX;
-      Position closestPos;
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        if (curDist < closestDist)
-        {
-          closestDist = curDist;
-          closestPos = epos;
-          closestEnemy = enemy;
-        }
-      });
-      if (ecs.is_valid(closestEnemy) && closestDist <= distance)
-      {
-        bb.set<flecs::entity>(entityBb, closestEnemy);
-        res = BEH_SUCCESS;
-      }
-    });
-    return res;
+    return beh::find_enemy(ecs, entity, bb, distance, entityBb);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::FindEnemy, distance, entityBb);
   }
 };
 
@@ -175,24 +302,16 @@ struct Flee : public BehNode
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
+  explicit Flee(size_t key) : entityBb(key) {}
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.insert([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        a.action = inverse_move(move_towards(pos, target_pos));
-      });
-    });
-    return res;
+    return beh::flee(entity, bb, entityBb);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::Flee, 0.f, entityBb);
   }
 };
 
@@ -204,24 +323,21 @@ struct Patrol : public BehNode
     : patrolDist(patrol_dist)
   {
     pposBb = reg_entity_blackboard_var<Position>(entity, bb_name);
-    entity.insert([&](Blackboard &bb, const Position &pos)
+    entity.insert([&](Blackboard &bb)
     {
-      bb.set<Position>(pposBb, pos);
+      beh::init_patrol(entity, bb, pposBb);
     });
   }
+  Patrol(float patrol_dist, size_t key) : pposBb(key), patrolDist(patrol_dist) {}
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.insert([&](Action &a, const Position &pos)
-    {
-      Position patrolPos = bb.get<Position>(pposBb);
-      if (dist(pos, patrolPos) > patrolDist)
-        a.action = move_towards(pos, patrolPos);
-      else
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
-    });
-    return res;
+    return beh::patrol(entity, bb, patrolDist, pposBb);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::Patrol, patrolDist, pposBb);
   }
 };
 
@@ -232,15 +348,12 @@ struct PatchUp : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &) override
   {
-    BehResult res = BEH_SUCCESS;
-    entity.insert([&](Action &a, Hitpoints &hp)
-    {
-      if (hp.hitpoints >= hpThreshold)
-        return;
-      res = BEH_RUNNING;
-      a.action = EA_HEAL_SELF;
-    });
-    return res;
+    return beh::patch_up(entity, hpThreshold);
+  }
+
+  uint32_t compile(FlatBehTreeBuilder &builder) const override
+  {
+    return builder.add(FlatOp::PatchUp, hpThreshold);
   }
 };
 
@@ -254,6 +367,17 @@ BehNode *sequence(const std::vector<BehNode*> &nodes)
   return seq;
 }
 
+BehNode *memory_sequence(const std::vector<BehNode*> &guards, const std::vector<BehNode*> &nodes)
+{
+  MemorySequence *seq = new MemorySequence;
+  seq->guardCount = uint16_t(guards.size());
+  for (BehNode *node : guards)
+    seq->pushNode(node);
+  for (BehNode *node : nodes)
+    seq->pushNode(node);
+  return seq;
+}
+
 BehNode *selector(const std::vector<BehNode*> &nodes)
 {
   Selector *sel = new Selector;
@@ -264,16 +388,54 @@ BehNode *selector(const std::vector<BehNode*> &nodes)
 
 BehNode *utility_selector(const std::vector<std::pair<BehNode*, utility_function>> &nodes)
 {
+  assert(nodes.size() <= max_utility_options && "too many utility options");
+  UtilitySelector *usel = new UtilitySelector;
+  for (const auto &node : nodes)
+  {
+    if (usel->utilityNodes.size() == max_utility_options)
+      delete node.first;
+    else
+      usel->utilityNodes.push_back(node);
+  }
+  return usel;
+}
+
+BehNode *linear_utility_selector(const std::vector<std::pair<BehNode*, LinearUtility>> &nodes)
+{
+  assert(nodes.size() <= max_utility_options && "too many utility options");
   UtilitySelector *usel = new UtilitySelector;
-  usel->utilityNodes = std::move(nodes);
+  for (const auto &node : nodes)
+  {
+    if (usel->utilityNodes.size() == max_utility_options)
+    {
+      delete node.first;
+      continue;
+    }
+    usel->utilityNodes.emplace_back(node.first, node.second);
+    usel->linear.push_back(node.second);
+  }
   return usel;
 }
 
+LinearUtility linear_utility(float bias, const std::vector<std::pair<const char*, float>> &terms)
+{
+  LinearUtility utility;
+  utility.bias = bias;
+  for (const auto &[name, weight] : terms)
+    utility.terms.emplace_back(bb_key<float>(name), weight);
+  return utility;
+}
+
 BehNode *move_to_entity(flecs::entity entity, const char *bb_name)
 {
   return new MoveToEntity(entity, bb_name);
 }
 
+BehNode *move_to_entity(const char *bb_name)
+{
+  return new MoveToEntity(bb_key<flecs::entity>(bb_name));
+}
+
 BehNode *is_low_hp(float thres)
 {
   return new IsLowHp(thres);
@@ -284,16 +446,31 @@ BehNode *find_enemy(flecs::entity entity, float dist, const char *bb_name)
   return new FindEnemy(entity, dist, bb_name);
 }
 
+BehNode *find_enemy(float dist, const char *bb_name)
+{
+  return new FindEnemy(dist, bb_key<flecs::entity>(bb_name));
+}
+
 BehNode *flee(flecs::entity entity, const char *bb_name)
 {
   return new Flee(entity, bb_name);
 }
 
+BehNode *flee(const char *bb_name)
+{
+  return new Flee(bb_key<flecs::entity>(bb_name));
+}
+
 BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name)
 {
   return new Patrol(entity, patrol_dist, bb_name);
 }
 
+BehNode *patrol(float patrol_dist, const char *bb_name)
+{
+  return new Patrol(patrol_dist, bb_key<Position>(bb_name));
+}
+
 BehNode *patch_up(float thres)
 {
   return new PatchUp(thres);
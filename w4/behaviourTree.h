@@ -1,7 +1,11 @@
 #pragma once
 
 #include <flecs.h>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <utility>
+#include <vector>
 #include "blackboard.h"
 
 enum BehResult
@@ -11,10 +15,53 @@ enum BehResult
   BEH_RUNNING
 };
 
+using utility_function = std::function<float(Blackboard&)>;
+
+// bias + sum of weight * float blackboard value, compiled trees score these for whole batches
+struct LinearUtility
+{
+  float bias = 0.f;
+  std::vector<std::pair<size_t, float>> terms; // float blackboard key, weight
+
+  float operator()(Blackboard &bb) const
+  {
+    float score = bias;
+    for (const auto &[key, weight] : terms)
+      score += weight * bb.get<float>(key);
+    return score;
+  }
+};
+
+constexpr size_t max_utility_options = 32;
+
+// Runs options from the best score down until one doesn't fail. Picks the next best option on each
+// round instead of sorting, usually the first pick already decides.
+template<typename Callable>
+inline BehResult run_by_utility(const float *scores, size_t count, Callable run_option)
+{
+  uint32_t tried = 0;
+  for (size_t attempt = 0; attempt < count; ++attempt)
+  {
+    size_t best = count;
+    for (size_t i = 0; i < count; ++i)
+      if (!((tried >> i) & 1u) && (best == count || scores[i] > scores[best]))
+        best = i;
+    tried |= 1u << best;
+    BehResult res = run_option(best);
+    if (res != BEH_FAIL)
+      return res;
+  }
+  return BEH_FAIL;
+}
+
+class FlatBehTreeBuilder;
+
 struct BehNode
 {
   virtual ~BehNode() {}
   virtual BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) = 0;
+  // emits the node and its children, returns the index of the node
+  virtual uint32_t compile(FlatBehTreeBuilder &builder) const = 0;
 };
 
 struct BehaviourTree
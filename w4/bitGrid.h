@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// one bit per tile, rows are padded to whole 64-bit words so spans and merges work on words,
+// padding bits always stay zero
+class BitGrid
+{
+public:
+  BitGrid() = default;
+  BitGrid(size_t width, size_t height)
+    : w(width), h(height), rowWords((width + 63) / 64), words(rowWords * height, 0) {}
+
+  size_t width() const { return w; }
+  size_t height() const { return h; }
+  size_t words_per_row() const { return rowWords; }
+
+  const uint64_t *row(size_t y) const { return words.data() + y * rowWords; }
+  uint64_t *row(size_t y) { return words.data() + y * rowWords; }
+
+  bool test(size_t x, size_t y) const { return (row(y)[x / 64] >> (x % 64)) & 1; }
+  void set(size_t x, size_t y) { row(y)[x / 64] |= uint64_t(1) << (x % 64); }
+
+  // sets [x0, x1] in row y, x1 inclusive
+  void set_span(size_t y, size_t x0, size_t x1)
+  {
+    uint64_t *r = row(y);
+    const size_t w0 = x0 / 64;
+    const size_t w1 = x1 / 64;
+    const uint64_t head = ~uint64_t(0) << (x0 % 64);
+    const uint64_t tail = ~uint64_t(0) >> (63 - x1 % 64);
+    if (w0 == w1)
+    {
+      r[w0] |= head & tail;
+      return;
+    }
+    r[w0] |= head;
+    for (size_t i = w0 + 1; i < w1; ++i)
+      r[i] = ~uint64_t(0);
+    r[w1] |= tail;
+  }
+
+  BitGrid &operator|=(const BitGrid &rhs)
+  {
+    for (size_t i = 0; i < words.size(); ++i)
+      words[i] |= rhs.words[i];
+    return *this;
+  }
+
+private:
+  size_t w = 0;
+  size_t h = 0;
+  size_t rowWords = 0;
+  std::vector<uint64_t> words;
+};
@@ -0,0 +1,306 @@
+// compares virtual, flat and static behaviour trees on the minotaur and fuzzy monster archetypes,
+// all three have to pick the same actions, and the virtual and flat patrol/attack/flee state machine.
+// Then checks how a compiled minotaur reacts to what it perceives, exits with 1 if anything fails.
+#include <flecs.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "ecsTypes.h"
+#include "aiUtils.h"
+#include "blackboard.h"
+#include "flatBehTree.h"
+#include "flatStateMachine.h"
+#include "monsterTrees.h"
+#include "perception.h"
+#include "rng.h"
+#include "sensors.h"
+
+struct BenchResult
+{
+  double ms = 0.0;
+  uint64_t actionsHash = 0;
+};
+
+static void select_rng_stream(size_t iteration, flecs::entity e)
+{
+  rng::select_stream(uint64_t(iteration) * 0x9e3779b97f4a7c15ull ^ e.id());
+}
+
+// tick_all(iteration) ticks every monster once, random draws are keyed per entity and iteration.
+// Actions are reset before and hashed after every iteration, only tick_all is timed.
+template<typename Callable>
+static BenchResult run_bench(const std::vector<flecs::entity> &monsters, size_t iterations, Callable tick_all)
+{
+  using clock = std::chrono::steady_clock;
+  BenchResult res;
+  for (size_t it = 0; it < iterations; ++it)
+  {
+    for (flecs::entity e : monsters)
+      e.insert([](Action &a) { a.action = EA_NOP; });
+    const auto start = clock::now();
+    tick_all(it);
+    res.ms += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    for (flecs::entity e : monsters)
+      e.get([&](const Action &a) { res.actionsHash = res.actionsHash * 31 + uint64_t(a.action); });
+  }
+  res.ms /= double(std::max(iterations, size_t(1)));
+  return res;
+}
+
+template<typename StaticTree>
+static bool compare_trees(flecs::world &ecs, const char *name, const std::vector<flecs::entity> &monsters,
+                          size_t iterations, BehNode *(*make_tree)())
+{
+  std::vector<Blackboard*> bbs;
+  for (flecs::entity e : monsters)
+    e.insert([&](Blackboard &bb) { bbs.push_back(&bb); });
+
+  // leaves of shared definitions are set up through the compiled tree, virtual trees use the same keys
+  const std::shared_ptr<const FlatBehTree> flatTree = compile_beh_tree(make_tree());
+  std::vector<FlatTreeState> flatStates;
+  std::vector<FlatTreeState*> flatStatePtrs;
+  for (size_t i = 0; i < monsters.size(); ++i)
+  {
+    flatTree->init_entity(monsters[i], *bbs[i]);
+    flatStates.push_back(flatTree->make_state());
+  }
+  for (FlatTreeState &state : flatStates)
+    flatStatePtrs.push_back(&state);
+
+  std::vector<BehaviourTree> virtualTrees;
+  for (size_t i = 0; i < monsters.size(); ++i)
+    virtualTrees.emplace_back(make_tree());
+  const BenchResult virtualRes = run_bench(monsters, iterations, [&](size_t it)
+  {
+    for (size_t i = 0; i < monsters.size(); ++i)
+    {
+      select_rng_stream(it, monsters[i]);
+      virtualTrees[i].update(ecs, monsters[i], *bbs[i]);
+    }
+  });
+
+  const BenchResult flatRes = run_bench(monsters, iterations, [&](size_t it)
+  {
+    flatTree->tick(ecs, monsters.data(), bbs.data(), flatStatePtrs.data(), monsters.size(),
+                   [&](flecs::entity e) { select_rng_stream(it, e); });
+  });
+
+  for (size_t i = 0; i < monsters.size(); ++i)
+    StaticTree::init(monsters[i], *bbs[i]);
+  const BenchResult staticRes = run_bench(monsters, iterations, [&](size_t it)
+  {
+    for (size_t i = 0; i < monsters.size(); ++i)
+    {
+      select_rng_stream(it, monsters[i]);
+      StaticTree::tick(ecs, monsters[i], *bbs[i]);
+    }
+  });
+
+  const bool match = virtualRes.actionsHash == flatRes.actionsHash && flatRes.actionsHash == staticRes.actionsHash;
+  printf("%-14s virtual: %8.3f ms, flat: %8.3f ms, static: %8.3f ms, %s\n", name,
+         virtualRes.ms, flatRes.ms, staticRes.ms, match ? "actions match" : "ACTIONS DIFFER");
+  return match;
+}
+
+// Virtual machines subscribe to the Perception of their monster and only re-check transitions on
+// its events, the flat one polls and is ticked in runs of monsters sharing a state like
+// plan_npc_actions does.
+static bool compare_machines(flecs::world &ecs, const std::vector<flecs::entity> &monsters, size_t iterations)
+{
+  std::vector<StateMachine> machines(monsters.size());
+  for (size_t i = 0; i < monsters.size(); ++i)
+  {
+    build_patrol_attack_flee_sm(machines[i]);
+    monsters[i].set(Perception{});
+    monsters[i].insert([&](Perception &perception) { machines[i].subscribe(perception); });
+  }
+  const BenchResult virtualRes = run_bench(monsters, iterations, [&](size_t it)
+  {
+    update_perception(ecs);
+    for (size_t i = 0; i < monsters.size(); ++i)
+    {
+      uint32_t events = PE_ALL;
+      monsters[i].get([&](const Perception &perception) { events = perception.events; });
+      select_rng_stream(it, monsters[i]);
+      machines[i].act(0.f, ecs, monsters[i], events);
+    }
+    clear_perception_events(ecs);
+  });
+
+  const std::shared_ptr<const FlatFsm> fsm = compile_state_machine(machines.front());
+  std::vector<uint32_t> states(monsters.size(), 0);
+  std::vector<size_t> order(monsters.size());
+  std::vector<flecs::entity> batch(monsters.size());
+  std::vector<uint32_t*> batchStates(monsters.size());
+  const BenchResult flatRes = run_bench(monsters, iterations, [&](size_t it)
+  {
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return states[lhs] < states[rhs]; });
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+      batch[i] = monsters[order[i]];
+      batchStates[i] = &states[order[i]];
+    }
+    for (size_t begin = 0; begin < batch.size();)
+    {
+      const uint32_t state = *batchStates[begin];
+      size_t runEnd = begin + 1;
+      while (runEnd < batch.size() && *batchStates[runEnd] == state)
+        ++runEnd;
+      fsm->tick(ecs, state, batch.data() + begin, batchStates.data() + begin, runEnd - begin,
+                [&](flecs::entity e) { select_rng_stream(it, e); });
+      begin = runEnd;
+    }
+  });
+
+  const bool match = virtualRes.actionsHash == flatRes.actionsHash;
+  printf("%-14s virtual: %8.3f ms, flat: %8.3f ms, %s\n", "patrol_sm", virtualRes.ms, flatRes.ms,
+         match ? "actions match" : "ACTIONS DIFFER");
+  return match;
+}
+
+// one turn of the game for a single tree, perception is updated before the decision and cleared after
+static void tick_turn(flecs::world &ecs, const FlatBehTree &tree, flecs::entity e, Blackboard &bb, FlatTreeState &state)
+{
+  update_perception(ecs);
+  e.get([&](const Perception &perception) { state.events = perception.events; });
+  tree.tick(ecs, e, bb, state);
+  clear_perception_events(ecs);
+}
+
+static int action_of(flecs::entity e)
+{
+  int action = EA_NOP;
+  e.get([&](const Action &a) { action = a.action; });
+  return action;
+}
+
+// A minotaur chases an enemy in range and has to give it up once it moved away, patrolling back
+// instead. Placed far away from the benchmark monsters and teams so none of them interfere.
+static bool check_drops_target(flecs::world &ecs)
+{
+  const Position home{1000, 1000};
+  flecs::entity target = ecs.entity()
+    .set(Position{home.x + 2, home.y + 4})
+    .set(Hitpoints{100.f})
+    .set(Team{3});
+  flecs::entity minotaur = ecs.entity()
+    .set(home)
+    .set(Hitpoints{100.f})
+    .set(Action{EA_NOP})
+    .set(Team{2})
+    .set(Blackboard{std::make_shared<BlackboardSchema>()})
+    .set(Perception{});
+  const std::shared_ptr<const FlatBehTree> tree = compile_beh_tree(make_minotaur_beh());
+  FlatTreeState state = tree->make_state();
+  Blackboard *bb = nullptr;
+  minotaur.insert([&](Blackboard &mbb) { bb = &mbb; });
+  tree->init_entity(minotaur, *bb); // patrols around home
+  minotaur.set(Position{home.x, home.y + 4});
+
+  tick_turn(ecs, *tree, minotaur, *bb, state);
+  const bool chased = action_of(minotaur) == EA_MOVE_RIGHT;
+  target.set(Position{home.x + 10, home.y + 4});
+  tick_turn(ecs, *tree, minotaur, *bb, state);
+  const bool dropped = action_of(minotaur) == EA_MOVE_UP;
+  const bool ok = chased && dropped;
+  target.destruct();
+  minotaur.destruct();
+  printf("%-14s %s\n", "drops target", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// The enemy check guarding the chase of a minotaur is skipped while perception reports nothing new,
+// a target planted on the blackboard is chased then. Once a closer enemy shows up it runs again.
+static bool check_guard_events(flecs::world &ecs)
+{
+  const Position home{2000, 2000};
+  flecs::entity target = ecs.entity()
+    .set(Position{home.x + 2, home.y})
+    .set(Hitpoints{100.f})
+    .set(Team{3});
+  flecs::entity decoy = ecs.entity().set(Position{home.x - 20, home.y}); // not an enemy of anyone
+  flecs::entity minotaur = ecs.entity()
+    .set(home)
+    .set(Hitpoints{100.f})
+    .set(Action{EA_NOP})
+    .set(Team{2})
+    .set(Blackboard{std::make_shared<BlackboardSchema>()})
+    .set(Perception{});
+  const std::shared_ptr<const FlatBehTree> tree = compile_beh_tree(make_minotaur_beh());
+  FlatTreeState state = tree->make_state();
+  Blackboard *bb = nullptr;
+  minotaur.insert([&](Blackboard &mbb) { bb = &mbb; });
+  tree->init_entity(minotaur, *bb);
+  const size_t attackEnemyBb = bb_key<flecs::entity>("attack_enemy");
+
+  tick_turn(ecs, *tree, minotaur, *bb, state);
+  const bool chased = action_of(minotaur) == EA_MOVE_RIGHT;
+  bb->set(attackEnemyBb, decoy);
+  tick_turn(ecs, *tree, minotaur, *bb, state);
+  const bool skipped = action_of(minotaur) == EA_MOVE_LEFT;
+  bb->set(attackEnemyBb, decoy);
+  flecs::entity closer = ecs.entity()
+    .set(Position{home.x, home.y + 1})
+    .set(Hitpoints{100.f})
+    .set(Team{3});
+  tick_turn(ecs, *tree, minotaur, *bb, state);
+  const bool rerun = action_of(minotaur) == EA_MOVE_DOWN;
+  const bool ok = chased && skipped && rerun;
+  for (flecs::entity e : {target, decoy, closer, minotaur})
+    e.destruct();
+  printf("%-14s %s\n", "guard events", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// usage: hw4_bt_bench [num_monsters] [iterations]
+int main(int argc, const char **argv)
+{
+  const size_t numMonsters = std::max(argc > 1 ? size_t(atoi(argv[1])) : 1000, size_t(1));
+  const size_t iterations = argc > 2 ? size_t(atoi(argv[2])) : 20;
+
+  rng::seed(42);
+  flecs::world ecs;
+  team_positions_query(ecs);
+  const int worldSize = 64;
+  auto schema = std::make_shared<BlackboardSchema>();
+  std::vector<flecs::entity> monsters;
+  for (size_t i = 0; i < numMonsters; ++i)
+    monsters.push_back(ecs.entity()
+      .set(Position{rng::range(0, worldSize - 1), rng::range(0, worldSize - 1)})
+      .set(Hitpoints{float(rng::range(10, 100))})
+      .set(Action{EA_NOP})
+      .set(Team{int(i % 2)})
+      .set(Sensors{})
+      .set(Blackboard{schema}));
+  for (flecs::entity e : monsters)
+    e.insert([](const Position &pos, PatrolPos &ppos) { ppos = PatrolPos{pos.x, pos.y}; });
+
+  // monsters never move, so one sensor pass serves every run and leaves read the closest enemy
+  // from it like in the game instead of scanning all monsters
+  update_sensors(ecs);
+
+  // what gather_world_info would have pushed, fuzzy monsters score on it
+  const size_t hpBb = bb_key<float>("hp");
+  const size_t enemyDistBb = bb_key<float>("enemyDist");
+  for (flecs::entity e : monsters)
+    e.insert([&](Blackboard &bb, const Hitpoints &hp, const Sensors &sensors)
+    {
+      bb.regKey<float>(hpBb);
+      bb.set(hpBb, hp.hitpoints);
+      bb.regKey<float>(enemyDistBb);
+      bb.set(enemyDistBb, std::min(sensors.closestEnemyDist, 100.f));
+    });
+
+  printf("monsters: %zu, iterations: %zu\n", numMonsters, iterations);
+  bool ok = compare_trees<MinotaurTree>(ecs, "minotaur", monsters, iterations, make_minotaur_beh);
+  ok = compare_trees<FuzzyMonsterTree>(ecs, "fuzzy_monster", monsters, iterations, make_fuzzy_monster_beh) && ok;
+  ok = compare_machines(ecs, monsters, iterations) && ok;
+  ok = check_drops_target(ecs) && ok;
+  ok = check_guard_events(ecs) && ok;
+  return ok ? 0 : 1;
+}
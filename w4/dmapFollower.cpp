@@ -1,45 +1,131 @@
 #include "ecsTypes.h"
 #include "dmapFollower.h"
+#include "workerPool.h"
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+// Sum of pow(v * mult, pow) over the maps of one weight configuration, built once per turn
+// and shared by all followers with that configuration.
+struct CombinedField
+{
+  struct Term
+  {
+    flecs::entity map;
+    DmapWeights::WtData wt;
+  };
+  std::vector<Term> terms; // sorted by map, equal configurations get equal terms
+  std::vector<float> values;
+};
+
+static size_t resolve_field(flecs::world &ecs, std::vector<CombinedField> &fields, const DmapWeights &wt)
+{
+  std::vector<CombinedField::Term> terms;
+  for (const auto &pair : wt.weights)
+    terms.push_back({ecs.entity(pair.first.c_str()), pair.second});
+  std::sort(terms.begin(), terms.end(), [](const CombinedField::Term &a, const CombinedField::Term &b)
+  {
+    return a.map.id() < b.map.id();
+  });
+  auto same_terms = [&](const CombinedField &field)
+  {
+    return std::equal(field.terms.begin(), field.terms.end(), terms.begin(), terms.end(),
+      [](const CombinedField::Term &a, const CombinedField::Term &b)
+      {
+        return a.map == b.map && a.wt.mult == b.wt.mult && a.wt.pow == b.wt.pow;
+      });
+  };
+  for (size_t i = 0; i < fields.size(); ++i)
+    if (same_terms(fields[i]))
+      return i;
+  fields.push_back({std::move(terms), {}});
+  return fields.size() - 1;
+}
 
 void process_dmap_followers(flecs::world &ecs)
 {
-  static auto processDmapFollowers = ecs.query<const Position, Action, const DmapWeights>();
+  static auto processDmapFollowers = ecs.query<const Position, Action, DmapWeights>();
   static auto dungeonDataQuery = ecs.query<const DungeonData>();
+  // configurations are few and live as long as the game, DmapWeights keep indices into it
+  static std::vector<CombinedField> fields;
 
-  auto get_dmap_at = [&](const DijkstraMapData &dmap, const DungeonData &dd, size_t x, size_t y, float mult, float pow)
+  struct Follower
   {
-    const float v = dmap.map[y * dd.width + x];
-    if (v < 1e5f)
-      return powf(v * mult, pow);
-    return v;
+    const Position *pos;
+    Action *act;
+    DmapWeights *wt;
   };
+  std::vector<Follower> followers;
+  processDmapFollowers.each([&](const Position &pos, Action &act, DmapWeights &wt)
+  {
+    followers.push_back({&pos, &act, &wt});
+  });
+  // outside of iteration, resolving may create map entities that don't exist yet
+  std::vector<uint8_t> used(fields.size(), 0);
+  for (Follower &f : followers)
+  {
+    if (f.wt->field >= fields.size())
+      f.wt->field = resolve_field(ecs, fields, *f.wt);
+    used.resize(fields.size(), 0);
+    used[f.wt->field] = 1;
+  }
+
   dungeonDataQuery.each([&](const DungeonData &dd)
   {
-    processDmapFollowers.each([&](const Position &pos, Action &act, const DmapWeights &wt)
+    const size_t numTiles = dd.width * dd.height;
+    for (size_t i = 0; i < fields.size(); ++i)
     {
-      float moveWeights[EA_MOVE_END];
-      for (size_t i = 0; i < EA_MOVE_END; ++i)
-        moveWeights[i] = 0.f;
-      for (const auto &pair : wt.weights)
+      if (!used[i])
+        continue;
+      CombinedField &field = fields[i];
+      struct Layer
+      {
+        const DijkstraMapData *dmap;
+        DmapWeights::WtData wt;
+      };
+      std::vector<Layer> layers;
+      for (const CombinedField::Term &term : field.terms)
       {
-        ecs.entity(pair.first.c_str()).get([&](const DijkstraMapData &dmap)
-        {
-          moveWeights[EA_NOP]         += get_dmap_at(dmap, dd, pos.x+0, pos.y+0, pair.second.mult, pair.second.pow);
-          moveWeights[EA_MOVE_LEFT]   += get_dmap_at(dmap, dd, pos.x-1, pos.y+0, pair.second.mult, pair.second.pow);
-          moveWeights[EA_MOVE_RIGHT]  += get_dmap_at(dmap, dd, pos.x+1, pos.y+0, pair.second.mult, pair.second.pow);
-          moveWeights[EA_MOVE_UP]     += get_dmap_at(dmap, dd, pos.x+0, pos.y-1, pair.second.mult, pair.second.pow);
-          moveWeights[EA_MOVE_DOWN]   += get_dmap_at(dmap, dd, pos.x+0, pos.y+1, pair.second.mult, pair.second.pow);
-        });
+        const DijkstraMapData *dmap = term.map.get<DijkstraMapData>();
+        if (dmap && dmap->map.size() == numTiles)
+          layers.push_back({dmap, term.wt});
+      }
+      field.values.assign(numTiles, 0.f);
+      jobs::parallel_for(numTiles, [&](size_t, size_t begin, size_t end)
+      {
+        for (const Layer &layer : layers)
+          for (size_t t = begin; t < end; ++t)
+          {
+            const float v = layer.dmap->at(t);
+            field.values[t] += v < 1e5f ? powf(v * layer.wt.mult, layer.wt.pow) : v;
+          }
+      });
+    }
+
+    jobs::parallel_for(followers.size(), [&](size_t, size_t begin, size_t end)
+    {
+      for (size_t f = begin; f < end; ++f)
+      {
+        const Position &pos = *followers[f].pos;
+        Action &act = *followers[f].act;
+        const std::vector<float> &values = fields[followers[f].wt->field].values;
+        if (values.empty())
+          continue;
+        const size_t idx = pos.y * dd.width + pos.x;
+        float moveWeights[EA_MOVE_END];
+        moveWeights[EA_NOP]         = values[idx];
+        moveWeights[EA_MOVE_LEFT]   = values[idx - 1];
+        moveWeights[EA_MOVE_RIGHT]  = values[idx + 1];
+        moveWeights[EA_MOVE_UP]     = values[idx - dd.width];
+        moveWeights[EA_MOVE_DOWN]   = values[idx + dd.width];
+        float minWt = moveWeights[EA_NOP];
+        for (size_t i = 0; i < EA_MOVE_END; ++i)
+          if (moveWeights[i] < minWt)
+          {
+            minWt = moveWeights[i];
+            act.action = i;
+          }
       }
-      float minWt = moveWeights[EA_NOP];
-      for (size_t i = 0; i < EA_MOVE_END; ++i)
-        if (moveWeights[i] < minWt)
-        {
-          minWt = moveWeights[i];
-          act.action = i;
-        }
     });
   });
 }
-
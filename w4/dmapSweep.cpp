@@ -0,0 +1,211 @@
+#include "dmapSweep.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DMAP_SWEEP_SSE2 1
+#endif
+// gcc and clang can build avx2 code for a single function and check the cpu at runtime,
+// msvc only gets it when the whole binary targets avx2 anyway
+#if defined(__GNUC__) || defined(__AVX2__)
+#define DMAP_SWEEP_AVX2 1
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define DMAP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DMAP_TARGET_AVX2
+#endif
+
+// walls cost this much to enter, so they never get a distance and never pass one on
+constexpr float blocked_tile_value = 1e30f;
+
+// row[x] = min(row[x], adj[x] + cost[x]), adj is the row above or below
+using RelaxRowFn = bool (*)(float *row, const float *adj, const float *cost, size_t n);
+
+static bool relax_row_scalar(float *row, const float *adj, const float *cost, size_t n)
+{
+  bool changed = false;
+  for (size_t x = 0; x < n; ++x)
+  {
+    const float cand = adj[x] + cost[x];
+    if (cand < row[x])
+    {
+      row[x] = cand;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+#if DMAP_SWEEP_SSE2
+static bool relax_row_sse2(float *row, const float *adj, const float *cost, size_t n)
+{
+  __m128 lowered = _mm_setzero_ps();
+  size_t x = 0;
+  for (; x + 4 <= n; x += 4)
+  {
+    const __m128 cur = _mm_loadu_ps(row + x);
+    const __m128 cand = _mm_add_ps(_mm_loadu_ps(adj + x), _mm_loadu_ps(cost + x));
+    lowered = _mm_or_ps(lowered, _mm_cmplt_ps(cand, cur));
+    _mm_storeu_ps(row + x, _mm_min_ps(cur, cand));
+  }
+  const bool tailChanged = relax_row_scalar(row + x, adj + x, cost + x, n - x);
+  return tailChanged || _mm_movemask_ps(lowered) != 0;
+}
+#endif
+
+#if DMAP_SWEEP_AVX2
+DMAP_TARGET_AVX2 static bool relax_row_avx2(float *row, const float *adj, const float *cost, size_t n)
+{
+  __m256 lowered = _mm256_setzero_ps();
+  size_t x = 0;
+  for (; x + 8 <= n; x += 8)
+  {
+    const __m256 cur = _mm256_loadu_ps(row + x);
+    const __m256 cand = _mm256_add_ps(_mm256_loadu_ps(adj + x), _mm256_loadu_ps(cost + x));
+    lowered = _mm256_or_ps(lowered, _mm256_cmp_ps(cand, cur, _CMP_LT_OQ));
+    _mm256_storeu_ps(row + x, _mm256_min_ps(cur, cand));
+  }
+  const bool tailChanged = relax_row_scalar(row + x, adj + x, cost + x, n - x);
+  return tailChanged || _mm256_movemask_ps(lowered) != 0;
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(__GNUC__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return true;
+#endif
+}
+#endif
+
+// left to right and back within a row, each step depends on the previous one so it stays scalar
+static void scan_row(float *row, const float *cost, size_t n)
+{
+  for (size_t x = 1; x < n; ++x)
+  {
+    const float cand = row[x - 1] + cost[x];
+    if (cand < row[x])
+      row[x] = cand;
+  }
+  for (size_t x = n - 1; x > 0; --x)
+  {
+    const float cand = row[x] + cost[x - 1];
+    if (cand < row[x - 1])
+      row[x - 1] = cand;
+  }
+}
+
+struct SweepKernel
+{
+  const char *name;
+  RelaxRowFn relax;
+};
+
+static const SweepKernel &sweep_kernel()
+{
+  static const SweepKernel kernel = []() -> SweepKernel
+  {
+#if DMAP_SWEEP_AVX2
+    if (cpu_has_avx2())
+      return {"avx2", relax_row_avx2};
+#endif
+#if DMAP_SWEEP_SSE2
+    return {"sse2", relax_row_sse2};
+#else
+    return {"scalar", relax_row_scalar};
+#endif
+  }();
+  return kernel;
+}
+
+const char *dmaps::sweep_kernel_name()
+{
+  return sweep_kernel().name;
+}
+
+// Top-down then bottom-up passes, a row first takes values from the row it is reached from
+// (vectorized) and then spreads them along itself. Rows are only revisited when the neighbour they
+// pull from got lower since, so later rounds only pay for paths that turn against the sweep.
+void dmaps::sweep_dmap(std::vector<float> &map, const WalkMask &grid, float sourceLimit)
+{
+  const size_t w = grid.width;
+  const size_t h = grid.height;
+  if (w == 0 || h == 0)
+    return;
+
+  // scratch is per thread so maps can be built concurrently
+  thread_local std::vector<float> dist;
+  thread_local std::vector<float> cost;
+  thread_local std::vector<uint8_t> pullAbove; // row above got lower since this row last looked at it
+  thread_local std::vector<uint8_t> pullBelow;
+  dist.resize(w * h);
+  cost.resize(w * h);
+  pullAbove.assign(h, 0);
+  pullBelow.assign(h, 0);
+
+  bool pending = false;
+  auto lowered = [&](size_t y)
+  {
+    if (y > 0)
+      pullBelow[y - 1] = 1;
+    if (y + 1 < h)
+      pullAbove[y + 1] = 1;
+    pending = true;
+  };
+  for (size_t y = 0; y < h; ++y)
+  {
+    bool hasSources = false;
+    for (size_t i = y * w; i < (y + 1) * w; ++i)
+    {
+      const bool isFloor = grid.walkable[i] != 0;
+      const bool isSource = isFloor && map[i] < sourceLimit;
+      cost[i] = isFloor ? 1.f : blocked_tile_value;
+      dist[i] = isSource ? map[i] : blocked_tile_value;
+      hasSources |= isSource;
+    }
+    if (hasSources)
+    {
+      scan_row(dist.data() + y * w, cost.data() + y * w, w);
+      lowered(y);
+    }
+  }
+
+  const RelaxRowFn relax = sweep_kernel().relax;
+  while (pending)
+  {
+    pending = false;
+    for (size_t y = 1; y < h; ++y)
+    {
+      if (!pullAbove[y])
+        continue;
+      pullAbove[y] = 0;
+      float *row = dist.data() + y * w;
+      if (relax(row, row - w, cost.data() + y * w, w))
+      {
+        scan_row(row, cost.data() + y * w, w);
+        lowered(y);
+      }
+    }
+    for (size_t y = h - 1; y-- > 0;)
+    {
+      if (!pullBelow[y])
+        continue;
+      pullBelow[y] = 0;
+      float *row = dist.data() + y * w;
+      if (relax(row, row + w, cost.data() + y * w, w))
+      {
+        scan_row(row, cost.data() + y * w, w);
+        lowered(y);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < w * h; ++i)
+    if (dist[i] < map[i])
+      map[i] = dist[i];
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+#include "dijkstraMapGen.h"
+
+// Raster sweep distance transform for maps where every floor tile costs 1.
+// Gives the same values as the bucket queue: tiles below sourceLimit are sources,
+// every floor tile ends up with min(own value, source value + path length over floor).
+namespace dmaps
+{
+  void sweep_dmap(std::vector<float> &map, const WalkMask &grid, float sourceLimit);
+
+  // "avx2", "sse2" or "scalar", picked once at runtime
+  const char *sweep_kernel_name();
+};
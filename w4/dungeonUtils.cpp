@@ -1,5 +1,5 @@
 #include "dungeonUtils.h"
-#include "raylib.h"
+#include "rng.h"
 
 Position dungeon::find_walkable_tile(flecs::world &ecs)
 {
@@ -14,7 +14,7 @@ Position dungeon::find_walkable_tile(flecs::world &ecs)
       for (size_t x = 0; x < dd.width; ++x)
         if (dd.tiles[y * dd.width + x] == dungeon::floor)
           posList.push_back(Position{int(x), int(y)});
-    size_t rndIdx = size_t(GetRandomValue(0, int(posList.size()) - 1));
+    size_t rndIdx = size_t(rng::range(0, int(posList.size()) - 1));
     res = posList[rndIdx];
   });
   return res;
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include "bitGrid.h"
 
 // TODO: make a lot of seprate files
 struct Position;
@@ -135,6 +137,15 @@ struct Team
 
 struct TextureSource {};
 
+// rgba tint, the render layer turns it into raylib Color
+struct Tint
+{
+  unsigned char r = 255;
+  unsigned char g = 255;
+  unsigned char b = 255;
+  unsigned char a = 255;
+};
+
 struct TurnCounter
 {
   int count = 0;
@@ -155,14 +166,37 @@ struct DungeonData
   size_t height;
 };
 
+// distances quantized to 16 bits: value = base + code * step, the two top codes are sentinels
 struct DijkstraMapData
 {
-  std::vector<float> map;
+  static constexpr float invalid_value = 1e5f; // not reachable from any source
+  static constexpr float forbidden_value = 1e6f;
+  static constexpr uint16_t invalid_code = 0xfffe;
+  static constexpr uint16_t forbidden_code = 0xffff;
+
+  std::vector<uint16_t> map;
+  float base = 0.f;
+  float step = 1.f;
+
+  float at(size_t idx) const
+  {
+    const uint16_t code = map[idx];
+    if (code < invalid_code)
+      return base + float(code) * step;
+    return code == invalid_code ? invalid_value : forbidden_value;
+  }
+};
+
+// sources of a dmap that is repaired instead of rebuilt, the distances are its DijkstraMapData codes
+struct DmapSources
+{
+  std::vector<uint32_t> tiles; // sorted sources it was built from
+  bool rebuild = false; // codes were clamped and can't be repaired, the next build starts over
 };
 
 struct ExplorationMap
 {
-  std::vector<bool> explored;
+  BitGrid explored;
 };
 
 struct VisualiseMap {};
@@ -175,6 +209,8 @@ struct DmapWeights
     float pow = 1.f;
   };
   std::unordered_map<std::string, WtData> weights;
+  // combined field shared by every follower with the same weights, resolved on first use
+  size_t field = size_t(-1);
 };
 
 struct Hive {};
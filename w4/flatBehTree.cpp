@@ -0,0 +1,228 @@
+#include "flatBehTree.h"
+#include "behLeaves.h"
+#include <algorithm>
+
+uint32_t FlatBehTreeBuilder::add(FlatOp op, float param, size_t key)
+{
+  FlatNode node;
+  node.op = op;
+  node.param = param;
+  node.key = key;
+  if (op == FlatOp::IsLowHp)
+    node.events = PE_HP_CROSSED;
+  else if (op == FlatOp::FindEnemy)
+    node.events = PE_ENEMY_RADIUS | PE_TARGET_DIED | PE_CLOSEST_CHANGED; // finds the closest enemy by entity
+  tree.nodes.push_back(node);
+  return uint32_t(tree.nodes.size() - 1);
+}
+
+void FlatBehTreeBuilder::add_state(uint32_t node, uint16_t guard_count)
+{
+  tree.nodes[node].guardCount = guard_count;
+  tree.nodes[node].stateIdx = tree.stateCount++;
+}
+
+void FlatBehTreeBuilder::link(uint32_t node, const std::vector<uint32_t> &kids,
+                              const std::vector<utility_function> &utilities)
+{
+  tree.nodes[node].firstChild = uint32_t(tree.children.size());
+  tree.nodes[node].childCount = uint32_t(kids.size());
+  for (size_t i = 0; i < kids.size(); ++i)
+  {
+    tree.children.push_back(kids[i]);
+    tree.utilities.push_back(i < utilities.size() ? utilities[i] : utility_function());
+  }
+}
+
+void FlatBehTreeBuilder::add_linear_scores(uint32_t node, const std::vector<LinearUtility> &linear)
+{
+  tree.nodes[node].scoreRow = uint32_t(tree.scoreRows.size());
+  for (const LinearUtility &utility : linear)
+  {
+    FlatBehTree::ScoreRow row;
+    row.bias = utility.bias;
+    row.firstTerm = uint32_t(tree.scoreTerms.size());
+    row.termCount = uint32_t(utility.terms.size());
+    for (const auto &[key, weight] : utility.terms)
+    {
+      auto itf = std::find(tree.scoreKeys.begin(), tree.scoreKeys.end(), key);
+      if (itf == tree.scoreKeys.end())
+        itf = tree.scoreKeys.insert(itf, key);
+      tree.scoreTerms.emplace_back(uint32_t(itf - tree.scoreKeys.begin()), weight);
+    }
+    tree.scoreRows.push_back(row);
+  }
+}
+
+std::shared_ptr<const FlatBehTree> compile_beh_tree(BehNode *root)
+{
+  FlatBehTreeBuilder builder;
+  root->compile(builder);
+  delete root;
+  return builder.finish();
+}
+
+void FlatBehTree::init_entity(flecs::entity entity, Blackboard &bb) const
+{
+  for (const FlatNode &node : nodes)
+  {
+    switch (node.op)
+    {
+    case FlatOp::MoveToEntity:
+    case FlatOp::FindEnemy:
+    case FlatOp::Flee:
+      bb.regKey<flecs::entity>(node.key);
+      break;
+    case FlatOp::Patrol:
+      beh::init_patrol(entity, bb, node.key);
+      break;
+    default:
+      break;
+    }
+  }
+  if (entity.has<Perception>())
+    entity.insert([&](Perception &perception)
+    {
+      for (const FlatNode &node : nodes)
+        if (node.op == FlatOp::IsLowHp)
+          perception.watch_hp(node.param);
+        else if (node.op == FlatOp::FindEnemy)
+          perception.watch_radius(node.param);
+    });
+}
+
+// Gathers every score column over the batch first, so rows are plain multiply-adds over arrays.
+void FlatBehTree::score_batch(Blackboard *const *bbs, size_t count, std::vector<float> &scores) const
+{
+  scores.resize(scoreRows.size() * count);
+  if (scoreRows.empty())
+    return;
+  thread_local std::vector<float> columns;
+  columns.resize(scoreKeys.size() * count);
+  for (size_t c = 0; c < scoreKeys.size(); ++c)
+  {
+    float *column = columns.data() + c * count;
+    for (size_t i = 0; i < count; ++i)
+      column[i] = bbs[i]->get<float>(scoreKeys[c]);
+  }
+  for (size_t r = 0; r < scoreRows.size(); ++r)
+  {
+    const ScoreRow &row = scoreRows[r];
+    float *out = scores.data() + r * count;
+    std::fill(out, out + count, row.bias);
+    for (uint32_t t = row.firstTerm; t < row.firstTerm + row.termCount; ++t)
+    {
+      const float *column = columns.data() + scoreTerms[t].first * count;
+      const float weight = scoreTerms[t].second;
+      for (size_t i = 0; i < count; ++i)
+        out[i] += weight * column[i];
+    }
+  }
+}
+
+float FlatBehTree::score_row(uint32_t row, Blackboard &bb) const
+{
+  const ScoreRow &r = scoreRows[row];
+  float score = r.bias;
+  for (uint32_t t = r.firstTerm; t < r.firstTerm + r.termCount; ++t)
+    score += scoreTerms[t].second * bb.get<float>(scoreKeys[scoreTerms[t].first]);
+  return score;
+}
+
+BehResult FlatBehTree::run(uint32_t idx, Context &ctx) const
+{
+  const FlatNode &node = nodes[idx];
+  const uint32_t *kids = children.data() + node.firstChild;
+  switch (node.op)
+  {
+  case FlatOp::Sequence:
+    for (uint32_t i = 0; i < node.childCount; ++i)
+    {
+      BehResult res = run(kids[i], ctx);
+      if (res != BEH_SUCCESS)
+        return res;
+    }
+    return BEH_SUCCESS;
+  case FlatOp::MemorySequence:
+  {
+    // guards are re-checked, the rest resumes at the child that was running on the previous tick,
+    // child is only ever set past the guards
+    FlatNodeState &ns = ctx.state.node(node.stateIdx);
+    const bool resumes = ns.lastTick + 1 == ctx.state.ticks && ns.child != 0;
+    ns.lastTick = ctx.state.ticks;
+    const uint32_t from = resumes ? ns.child : node.guardCount;
+    ns.child = 0;
+    for (uint32_t i = 0; i < node.guardCount; ++i)
+    {
+      // a guard that passed on the previous tick still passes if none of its events fired since
+      if (resumes && !(nodes[kids[i]].events & ctx.state.events))
+        continue;
+      BehResult res = run(kids[i], ctx);
+      if (res != BEH_SUCCESS)
+        return res;
+    }
+    for (uint32_t i = from; i < node.childCount; ++i)
+    {
+      BehResult res = run(kids[i], ctx);
+      if (res == BEH_RUNNING)
+        ns.child = i;
+      if (res != BEH_SUCCESS)
+        return res;
+    }
+    return BEH_SUCCESS;
+  }
+  case FlatOp::Selector:
+    for (uint32_t i = 0; i < node.childCount; ++i)
+    {
+      BehResult res = run(kids[i], ctx);
+      if (res != BEH_FAIL)
+        return res;
+    }
+    return BEH_FAIL;
+  case FlatOp::UtilitySelector:
+  {
+    float scores[max_utility_options];
+    const utility_function *utility = utilities.data() + node.firstChild;
+    for (uint32_t i = 0; i < node.childCount; ++i)
+    {
+      if (node.scoreRow == uint32_t(-1))
+        scores[i] = utility[i](ctx.bb);
+      else if (ctx.scores)
+        scores[i] = ctx.scores[(node.scoreRow + i) * ctx.scoreStride];
+      else
+        scores[i] = score_row(node.scoreRow + i, ctx.bb);
+    }
+    return run_by_utility(scores, node.childCount, [&](size_t i) { return run(kids[i], ctx); });
+  }
+  case FlatOp::MoveToEntity:
+    return beh::move_to_entity(ctx.entity, ctx.bb, node.key);
+  case FlatOp::IsLowHp:
+    return beh::is_low_hp(ctx.entity, node.param);
+  case FlatOp::FindEnemy:
+    return beh::find_enemy(ctx.ecs, ctx.entity, ctx.bb, node.param, node.key);
+  case FlatOp::Flee:
+    return beh::flee(ctx.entity, ctx.bb, node.key);
+  case FlatOp::Patrol:
+    return beh::patrol(ctx.entity, ctx.bb, node.param, node.key);
+  case FlatOp::PatchUp:
+    return beh::patch_up(ctx.entity, node.param);
+  }
+  return BEH_FAIL;
+}
+
+BehResult FlatBehTree::tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb, FlatTreeState &state) const
+{
+  return tick_scored(ecs, entity, bb, state, nullptr, 0);
+}
+
+BehResult FlatBehTree::tick_scored(flecs::world &ecs, flecs::entity entity, Blackboard &bb, FlatTreeState &state,
+                                   const float *scores, size_t score_stride) const
+{
+  if (nodes.empty())
+    return BEH_FAIL;
+  if (state.node_count() != stateCount)
+    state = make_state();
+  ++state.ticks;
+  Context ctx{ecs, entity, bb, state, scores, score_stride};
+  return run(0, ctx);
+}
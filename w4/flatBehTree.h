@@ -0,0 +1,162 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <flecs.h>
+#include "behaviourTree.h"
+#include "blackboard.h"
+#include "perception.h"
+
+enum class FlatOp : uint8_t
+{
+  Sequence,
+  MemorySequence,
+  Selector,
+  UtilitySelector,
+  MoveToEntity,
+  IsLowHp,
+  FindEnemy,
+  Flee,
+  Patrol,
+  PatchUp
+};
+
+struct FlatNode
+{
+  FlatOp op = FlatOp::Sequence;
+  uint16_t guardCount = 0; // memory sequences, leading children re-checked on every tick
+  uint32_t firstChild = 0; // into FlatBehTree children, children of a node are contiguous there
+  uint32_t childCount = 0;
+  uint32_t stateIdx = 0; // memory sequences, FlatTreeState::node
+  uint32_t scoreRow = uint32_t(-1); // linear utility selectors, first batch score row of the options
+  float param = 0.f; // distance or threshold of leaves
+  size_t key = size_t(-1); // blackboard key of leaves
+  uint32_t events = PE_ALL; // perception events that can change the result of the node
+};
+
+// where a memory sequence stopped, only valid if it was ticked on the previous tick of the tree
+struct FlatNodeState
+{
+  uint32_t child = 0; // 0 starts over
+  uint32_t lastTick = 0;
+};
+
+// Per entity, sized by FlatBehTree::make_state. Node states of small trees are kept inline,
+// so giving an entity a tree doesn't allocate.
+class FlatTreeState
+{
+public:
+  static constexpr uint32_t inline_nodes = 4;
+
+  uint32_t ticks = 0;
+  uint32_t events = PE_ALL; // perception events since the previous tick, set by whoever ticks the tree
+
+  explicit FlatTreeState(uint32_t count = 0) : size(count)
+  {
+    if (count > inline_nodes)
+      spilled.resize(count);
+  }
+
+  uint32_t node_count() const { return size; }
+  FlatNodeState &node(uint32_t idx) { return size <= inline_nodes ? inlineNodes[idx] : spilled[idx]; }
+
+private:
+  uint32_t size = 0;
+  FlatNodeState inlineNodes[inline_nodes];
+  std::vector<FlatNodeState> spilled; // trees with more memory sequences than fit inline
+};
+
+// Behaviour tree compiled into one node array, children are referenced by index and nodes are
+// dispatched with a switch. Immutable after compilation, so one tree is ticked for many entities.
+class FlatBehTree
+{
+public:
+  // registers leaf keys and sets up per-entity leaf data, call once per entity. Conditions are
+  // watched in the Perception of the entity if it has one.
+  void init_entity(flecs::entity entity, Blackboard &bb) const;
+  FlatTreeState make_state() const { return FlatTreeState(stateCount); }
+
+  BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb, FlatTreeState &state) const;
+  // Ticks a batch of entities sharing this tree, entities[i] uses bbs[i] and states[i]. Entities are
+  // made mutable on ecs (a stage when run from workers), before(entity) runs ahead of each tick.
+  // Linear utilities are scored for the whole batch up front, one row per option over all entities.
+  template<typename Callable>
+  void tick(flecs::world &ecs, const flecs::entity *entities, Blackboard *const *bbs,
+            FlatTreeState *const *states, size_t count, Callable before) const
+  {
+    thread_local std::vector<float> scores;
+    score_batch(bbs, count, scores);
+    for (size_t i = 0; i < count; ++i)
+    {
+      before(entities[i]);
+      tick_scored(ecs, entities[i].mut(ecs), *bbs[i], *states[i], scores.empty() ? nullptr : scores.data() + i, count);
+    }
+  }
+
+  size_t size() const { return nodes.size(); }
+
+private:
+  friend class FlatBehTreeBuilder;
+
+  struct Context
+  {
+    flecs::world &ecs;
+    flecs::entity entity;
+    Blackboard &bb;
+    FlatTreeState &state;
+    const float *scores; // batch score of this entity in row 0, null when ticked alone
+    size_t scoreStride;
+  };
+
+  // bias + sum of weight * batch column
+  struct ScoreRow
+  {
+    float bias = 0.f;
+    uint32_t firstTerm = 0;
+    uint32_t termCount = 0;
+  };
+
+  void score_batch(Blackboard *const *bbs, size_t count, std::vector<float> &scores) const;
+  float score_row(uint32_t row, Blackboard &bb) const;
+  BehResult tick_scored(flecs::world &ecs, flecs::entity entity, Blackboard &bb, FlatTreeState &state,
+                        const float *scores, size_t score_stride) const;
+  BehResult run(uint32_t idx, Context &ctx) const;
+
+  std::vector<FlatNode> nodes; // pre-order, root first
+  std::vector<uint32_t> children;
+  std::vector<utility_function> utilities; // same indexing as children, only set under utility selectors
+  uint32_t stateCount = 0;
+
+  std::vector<size_t> scoreKeys; // float blackboard keys gathered into batch columns
+  std::vector<ScoreRow> scoreRows;
+  std::vector<std::pair<uint32_t, float>> scoreTerms; // column, weight
+};
+
+// Collects nodes while BehNode::compile walks the tree.
+class FlatBehTreeBuilder
+{
+public:
+  // add the node before compiling its children so the array stays in pre-order
+  uint32_t add(FlatOp op, float param = 0.f, size_t key = size_t(-1));
+  // gives the node a slot in the per-entity state
+  void add_state(uint32_t node, uint16_t guard_count);
+  void link(uint32_t node, const std::vector<uint32_t> &kids,
+            const std::vector<utility_function> &utilities = {});
+  // lets batches score the options of a linked utility selector, one utility per child
+  void add_linear_scores(uint32_t node, const std::vector<LinearUtility> &linear);
+
+  std::shared_ptr<const FlatBehTree> finish() { return std::make_shared<const FlatBehTree>(std::move(tree)); }
+
+private:
+  FlatBehTree tree;
+};
+
+// takes the builder output of aiLibrary, the virtual tree is deleted
+std::shared_ptr<const FlatBehTree> compile_beh_tree(BehNode *root);
+
+// the tree is shared by every entity of an archetype, only the state is per entity
+struct FlatBehaviourTree
+{
+  std::shared_ptr<const FlatBehTree> tree;
+  FlatTreeState state;
+};
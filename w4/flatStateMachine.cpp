@@ -0,0 +1,159 @@
+#include "flatStateMachine.h"
+#include <algorithm>
+#include <float.h>
+#include "aiUtils.h"
+#include "math.h"
+#include "rng.h"
+
+uint32_t FlatFsmBuilder::add_state(FsmAct act, float param)
+{
+  FlatFsm::StateDef state;
+  state.act = act;
+  state.param = param;
+  fsm.states.push_back(state);
+  return uint32_t(fsm.states.size() - 1);
+}
+
+void FlatFsmBuilder::emit(FsmOp op, float param)
+{
+  fsm.code.push_back(FsmInstr{op, param});
+  if (op == FsmOp::EnemyWithin || op == FsmOp::HpBelow || op == FsmOp::Const)
+    fsm.maxDepth = std::max(fsm.maxDepth, ++depth);
+  else if (op == FsmOp::And)
+    --depth;
+}
+
+void FlatFsmBuilder::add_transition(uint32_t from, uint32_t to)
+{
+  FlatFsm::StateDef &state = fsm.states[from];
+  if (state.transitionCount == 0)
+    state.firstTransition = uint32_t(fsm.transitions.size());
+  ++state.transitionCount;
+  fsm.transitions.push_back(FlatFsm::TransitionDef{codeStart, uint32_t(fsm.code.size()) - codeStart, to});
+  codeStart = uint32_t(fsm.code.size());
+  depth = 0;
+}
+
+std::shared_ptr<const FlatFsm> compile_state_machine(const StateMachine &sm)
+{
+  FlatFsmBuilder builder;
+  sm.compile(builder);
+  return builder.finish();
+}
+
+void FlatFsm::read_sensors(flecs::world &ecs, const flecs::entity *entities, size_t count, FsmSensors *out) const
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    FsmSensors &s = out[i];
+    const ClosestEnemy enemy = closest_enemy(ecs, entities[i]);
+    s.enemyDist = enemy.dist;
+    s.enemyPos = enemy.pos;
+    entities[i].get([&](const Position &pos, const Hitpoints &hp)
+    {
+      s.pos = pos;
+      s.hp = hp.hitpoints;
+    });
+  }
+}
+
+void FlatFsm::eval(const TransitionDef &trans, const FsmSensors *sensors, size_t count, uint8_t *res) const
+{
+  thread_local std::vector<uint8_t> stack;
+  stack.resize(std::max(maxDepth, 1u) * count);
+  uint8_t *top = stack.data(); // next free slot, one bool per entity
+  for (uint32_t c = trans.firstInstr; c < trans.firstInstr + trans.instrCount; ++c)
+  {
+    const FsmInstr &instr = code[c];
+    switch (instr.op)
+    {
+    case FsmOp::EnemyWithin:
+      for (size_t i = 0; i < count; ++i)
+        top[i] = sensors[i].enemyDist <= instr.param;
+      top += count;
+      break;
+    case FsmOp::HpBelow:
+      for (size_t i = 0; i < count; ++i)
+        top[i] = sensors[i].hp < instr.param;
+      top += count;
+      break;
+    case FsmOp::Const:
+      std::fill(top, top + count, uint8_t(instr.param != 0.f));
+      top += count;
+      break;
+    case FsmOp::Not:
+      for (uint8_t *v = top - count; v < top; ++v)
+        *v = !*v;
+      break;
+    case FsmOp::And:
+    {
+      uint8_t *lhs = top - 2 * count;
+      const uint8_t *rhs = top - count;
+      for (size_t i = 0; i < count; ++i)
+        lhs[i] &= rhs[i];
+      top -= count;
+      break;
+    }
+    }
+  }
+  if (top == stack.data())
+    std::fill(res, res + count, uint8_t(0));
+  else
+    std::copy(stack.data(), stack.data() + count, res);
+}
+
+void FlatFsm::transition(uint32_t state, const FsmSensors *sensors, size_t count, uint32_t *next) const
+{
+  std::fill(next, next + count, state);
+  if (state >= states.size())
+    return;
+  thread_local std::vector<uint8_t> decided;
+  thread_local std::vector<uint8_t> res;
+  decided.assign(count, 0);
+  res.resize(count);
+  const StateDef &def = states[state];
+  size_t undecided = count;
+  for (uint32_t t = def.firstTransition; t < def.firstTransition + def.transitionCount && undecided > 0; ++t)
+  {
+    eval(transitions[t], sensors, count, res.data());
+    for (size_t i = 0; i < count; ++i)
+      if (res[i] && !decided[i])
+      {
+        decided[i] = 1;
+        next[i] = transitions[t].to;
+        --undecided;
+      }
+  }
+}
+
+// same as the states of aiLibrary
+void FlatFsm::act(uint32_t state, flecs::entity entity, const FsmSensors &sensors) const
+{
+  if (state >= states.size())
+    return;
+  const StateDef &def = states[state];
+  switch (def.act)
+  {
+  case FsmAct::Nop:
+    break;
+  case FsmAct::MoveToEnemy:
+  case FsmAct::FleeFromEnemy:
+    if (sensors.enemyDist == FLT_MAX)
+      break;
+    entity.insert([&](Action &a)
+    {
+      const int move = move_towards(sensors.pos, sensors.enemyPos);
+      a.action = def.act == FsmAct::MoveToEnemy ? move : inverse_move(move);
+    });
+    break;
+  case FsmAct::Patrol:
+    entity.insert([&](const PatrolPos &ppos, Action &a)
+    {
+      if (dist(sensors.pos, ppos) > def.param)
+        a.action = move_towards(sensors.pos, ppos); // do a recovery walk
+      else
+        a.action = rng::range(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
+    });
+    break;
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "stateMachine.h"
+
+// condition code, a stack machine over bools
+enum class FsmOp : uint8_t
+{
+  EnemyWithin, // pushes closest enemy distance <= param
+  HpBelow, // pushes hitpoints < param
+  Const, // pushes param != 0
+  Not,
+  And
+};
+
+// what a state does on act
+enum class FsmAct : uint8_t
+{
+  Nop,
+  MoveToEnemy,
+  FleeFromEnemy,
+  Patrol // param is the patrol distance
+};
+
+struct FsmInstr
+{
+  FsmOp op = FsmOp::Const;
+  float param = 0.f;
+};
+
+// read once per entity and tick, conditions and actions only look at these
+struct FsmSensors
+{
+  Position pos;
+  float hp = 0.f;
+  float enemyDist = 0.f; // FLT_MAX without enemies
+  Position enemyPos;
+};
+
+// State machine compiled into flat tables, a state owns a contiguous range of transitions and
+// every transition a range of condition code. Immutable after compilation, so one machine is
+// shared by many entities.
+class FlatFsm
+{
+public:
+  // Ticks a batch of entities that are all in state, entities[i] keeps its state in states[i].
+  // Conditions run one instruction at a time over the whole batch. Entities are made mutable on
+  // ecs (a stage when run from workers), before(entity) runs ahead of each action.
+  template<typename Callable>
+  void tick(flecs::world &ecs, uint32_t state, const flecs::entity *entities, uint32_t *const *states,
+            size_t count, Callable before) const
+  {
+    thread_local std::vector<FsmSensors> sensors;
+    thread_local std::vector<uint32_t> next;
+    sensors.resize(count);
+    next.resize(count);
+    read_sensors(ecs, entities, count, sensors.data());
+    transition(state, sensors.data(), count, next.data());
+    for (size_t i = 0; i < count; ++i)
+    {
+      before(entities[i]);
+      act(next[i], entities[i].mut(ecs), sensors[i]);
+      *states[i] = next[i];
+    }
+  }
+
+  uint32_t state_count() const { return uint32_t(states.size()); }
+
+private:
+  friend class FlatFsmBuilder;
+
+  struct StateDef
+  {
+    FsmAct act = FsmAct::Nop;
+    float param = 0.f;
+    uint32_t firstTransition = 0;
+    uint32_t transitionCount = 0;
+  };
+
+  struct TransitionDef
+  {
+    uint32_t firstInstr = 0;
+    uint32_t instrCount = 0;
+    uint32_t to = 0;
+  };
+
+  void read_sensors(flecs::world &ecs, const flecs::entity *entities, size_t count, FsmSensors *out) const;
+  // next[i] is the state entity i ends up in, the first available transition wins
+  void transition(uint32_t state, const FsmSensors *sensors, size_t count, uint32_t *next) const;
+  void eval(const TransitionDef &trans, const FsmSensors *sensors, size_t count, uint8_t *res) const;
+  void act(uint32_t state, flecs::entity entity, const FsmSensors &sensors) const;
+
+  std::vector<StateDef> states;
+  std::vector<TransitionDef> transitions; // grouped by source state, in priority order
+  std::vector<FsmInstr> code;
+  uint32_t maxDepth = 0; // of the condition stack
+};
+
+// Collects states and transitions while StateMachine::compile walks the machine.
+class FlatFsmBuilder
+{
+public:
+  uint32_t add_state(FsmAct act, float param = 0.f);
+  void emit(FsmOp op, float param = 0.f);
+  // takes the code emitted since the previous transition, transitions have to come by source state
+  void add_transition(uint32_t from, uint32_t to);
+
+  std::shared_ptr<const FlatFsm> finish() { return std::make_shared<const FlatFsm>(std::move(fsm)); }
+
+private:
+  FlatFsm fsm;
+  uint32_t codeStart = 0;
+  uint32_t depth = 0;
+};
+
+std::shared_ptr<const FlatFsm> compile_state_machine(const StateMachine &sm);
+
+struct FlatStateMachine
+{
+  std::shared_ptr<const FlatFsm> fsm;
+  uint32_t state = 0;
+};
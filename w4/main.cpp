@@ -4,7 +4,10 @@
 #include <algorithm>
 #include "ecsTypes.h"
 #include "roguelike.h"
+#include "roguelikeRender.h"
 #include "dungeonGen.h"
+#include "rng.h"
+#include <chrono>
 
 static void update_camera(Camera2D &cam, flecs::world &ecs)
 {
@@ -32,6 +35,8 @@ int main(int /*argc*/, const char ** /*argv*/)
     SetWindowSize(width, height);
   }
 
+  rng::seed(unsigned(std::chrono::system_clock::now().time_since_epoch().count()));
+
   flecs::world ecs;
   {
     constexpr size_t dungWidth = 50;
@@ -40,6 +45,8 @@ int main(int /*argc*/, const char ** /*argv*/)
     gen_drunk_dungeon(tiles, dungWidth, dungHeight);
     init_dungeon(ecs, tiles, dungWidth, dungHeight);
   }
+  init_dungeon_render(ecs);
+  init_roguelike_render(ecs);
   init_roguelike(ecs);
 
   Camera2D camera = { {0, 0}, {0, 0}, 0.f, 1.f };
@@ -51,6 +58,7 @@ int main(int /*argc*/, const char ** /*argv*/)
   SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
   while (!WindowShouldClose())
   {
+    apply_player_input(ecs, read_keyboard_input());
     process_turn(ecs);
     update_camera(camera, ecs);
 
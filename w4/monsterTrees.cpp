@@ -0,0 +1,86 @@
+#include "monsterTrees.h"
+#include "aiLibrary.h"
+#include <utility>
+
+BehNode *make_minotaur_beh()
+{
+  return selector({
+    sequence({
+      is_low_hp(50.f),
+      find_enemy(4.f, "flee_enemy"),
+      flee("flee_enemy")
+    }),
+    // the enemy check guards the chase, a target that got out of range is dropped and a closer
+    // enemy is picked up on the next tick. With a single node after the guard resuming skips
+    // nothing, compiled trees only save work by skipping the guard on turns without perception events.
+    memory_sequence({find_enemy(3.f, "attack_enemy")}, {move_to_entity("attack_enemy")}),
+    patrol(2.f, "patrol_pos")
+  });
+}
+
+BehNode *make_fuzzy_monster_beh()
+{
+  return linear_utility_selector({
+    std::make_pair(
+      sequence({
+        find_enemy(4.f, "flee_enemy"),
+        flee("flee_enemy")
+      }),
+      // (100 - hp) * 5 - 50 * enemyDist
+      linear_utility(500.f, {{"hp", -5.f}, {"enemyDist", -50.f}})
+    ),
+    std::make_pair(
+      memory_sequence({find_enemy(3.f, "attack_enemy")}, {move_to_entity("attack_enemy")}),
+      linear_utility(100.f, {{"enemyDist", -10.f}})
+    ),
+    std::make_pair(
+      patrol(2.f, "patrol_pos"),
+      linear_utility(50.f, {})
+    ),
+    std::make_pair(
+      patch_up(100.f),
+      linear_utility(140.f, {{"hp", -1.f}})
+    )
+  });
+}
+
+void build_patrol_attack_flee_sm(StateMachine &sm)
+{
+  int patrol = sm.addState(create_patrol_state(3.f));
+  int moveToEnemy = sm.addState(create_move_to_enemy_state());
+  int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
+
+  sm.addTransition(create_enemy_available_transition(3.f), patrol, moveToEnemy);
+  sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), moveToEnemy, patrol);
+
+  sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(5.f)),
+                   moveToEnemy, fleeFromEnemy);
+  sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(3.f)),
+                   patrol, fleeFromEnemy);
+
+  sm.addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, patrol);
+}
+
+float fuzzy_flee_score(Blackboard &bb)
+{
+  static const size_t hpBb = bb_key<float>("hp");
+  static const size_t enemyDistBb = bb_key<float>("enemyDist");
+  return (100.f - bb.get<float>(hpBb)) * 5.f - 50.f * bb.get<float>(enemyDistBb);
+}
+
+float fuzzy_attack_score(Blackboard &bb)
+{
+  static const size_t enemyDistBb = bb_key<float>("enemyDist");
+  return 100.f - 10.f * bb.get<float>(enemyDistBb);
+}
+
+float fuzzy_patrol_score(Blackboard &)
+{
+  return 50.f;
+}
+
+float fuzzy_patch_up_score(Blackboard &bb)
+{
+  static const size_t hpBb = bb_key<float>("hp");
+  return 140.f - bb.get<float>(hpBb);
+}
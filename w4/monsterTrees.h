@@ -0,0 +1,34 @@
+#pragma once
+#include "behaviourTree.h"
+#include "blackboard.h"
+#include "stateMachine.h"
+#include "staticBehTree.h"
+
+// Behaviour of the monster archetypes. The game compiles the builders once into shared flat trees,
+// btBench runs them as virtual, flat and static trees and checks they pick the same actions.
+// Changing a builder means changing its static type below as well.
+BehNode *make_minotaur_beh();
+BehNode *make_fuzzy_monster_beh();
+
+// patrols, chases enemies within 3 tiles and flees from them when hurt, built in place
+void build_patrol_attack_flee_sm(StateMachine &sm);
+
+// scores of the fuzzy monster options, the builder uses the same ones as linear utilities
+float fuzzy_flee_score(Blackboard &bb);
+float fuzzy_attack_score(Blackboard &bb);
+float fuzzy_patrol_score(Blackboard &bb);
+float fuzzy_patch_up_score(Blackboard &bb);
+
+using MinotaurTree =
+  sbt::Selector<
+    sbt::Sequence<sbt::IsLowHp<50.f>, sbt::FindEnemy<4.f, "flee_enemy">, sbt::Flee<"flee_enemy">>,
+    sbt::MemorySequence<sbt::Guards<sbt::FindEnemy<3.f, "attack_enemy">>, sbt::MoveToEntity<"attack_enemy">>,
+    sbt::Patrol<2.f, "patrol_pos">>;
+
+using FuzzyMonsterTree =
+  sbt::UtilitySelector<
+    sbt::Utility<fuzzy_flee_score, sbt::Sequence<sbt::FindEnemy<4.f, "flee_enemy">, sbt::Flee<"flee_enemy">>>,
+    sbt::Utility<fuzzy_attack_score,
+      sbt::MemorySequence<sbt::Guards<sbt::FindEnemy<3.f, "attack_enemy">>, sbt::MoveToEntity<"attack_enemy">>>,
+    sbt::Utility<fuzzy_patrol_score, sbt::Patrol<2.f, "patrol_pos">>,
+    sbt::Utility<fuzzy_patch_up_score, sbt::PatchUp<100.f>>>;
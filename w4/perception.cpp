@@ -0,0 +1,68 @@
+#include "perception.h"
+#include "aiUtils.h"
+
+template<typename T>
+static void add_watch(T (&watches)[Perception::max_watches], uint8_t &count, bool &overflow, T val)
+{
+  for (uint8_t i = 0; i < count; ++i)
+    if (watches[i] == val)
+      return;
+  if (count == Perception::max_watches)
+    overflow = true;
+  else
+    watches[count++] = val;
+}
+
+void Perception::watch_radius(float radius)
+{
+  add_watch(radii, numRadii, overflow, radius);
+}
+
+void Perception::watch_hp(float thres)
+{
+  add_watch(hpThresholds, numHpThresholds, overflow, thres);
+}
+
+void update_perception(flecs::world &ecs)
+{
+  static auto perceptionQuery = ecs.query<Perception, const Hitpoints>();
+  perceptionQuery.each([&](flecs::entity e, Perception &p, const Hitpoints &hp)
+  {
+    const ClosestEnemy enemy = closest_enemy(ecs, e);
+    const float closestDist = enemy.dist;
+    const flecs::entity closestEnemy = enemy.entity;
+
+    // same comparisons as the conditions watching them
+    uint8_t enemyWithin = 0;
+    for (uint8_t i = 0; i < p.numRadii; ++i)
+      if (closestDist <= p.radii[i])
+        enemyWithin |= uint8_t(1 << i);
+    uint8_t hpBelow = 0;
+    for (uint8_t i = 0; i < p.numHpThresholds; ++i)
+      if (hp.hitpoints < p.hpThresholds[i])
+        hpBelow |= uint8_t(1 << i);
+
+    if (enemyWithin & ~p.enemyWithin)
+      p.events |= PE_ENEMY_ENTERED;
+    if (p.enemyWithin & ~enemyWithin)
+      p.events |= PE_ENEMY_LEFT;
+    if (hpBelow != p.hpBelow)
+      p.events |= PE_HP_CROSSED;
+    if (p.closestEnemy.id() != 0 && !p.closestEnemy.is_alive())
+      p.events |= PE_TARGET_DIED;
+    if (closestEnemy.id() != p.closestEnemy.id())
+      p.events |= PE_CLOSEST_CHANGED;
+    if (p.overflow)
+      p.events = PE_ALL;
+
+    p.enemyWithin = enemyWithin;
+    p.hpBelow = hpBelow;
+    p.closestEnemy = closestEnemy;
+  });
+}
+
+void clear_perception_events(flecs::world &ecs)
+{
+  static auto perceptionQuery = ecs.query<Perception>();
+  perceptionQuery.each([](Perception &p) { p.events = 0; });
+}
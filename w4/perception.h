@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <flecs.h>
+
+// what changed around an entity since its previous decision
+enum PerceptionEvent : uint32_t
+{
+  PE_ENEMY_ENTERED = 1 << 0, // closest enemy came within one of the watched radii
+  PE_ENEMY_LEFT = 1 << 1, // or got out of one
+  PE_HP_CROSSED = 1 << 2, // hitpoints crossed one of the watched thresholds
+  PE_TARGET_DIED = 1 << 3, // closest enemy of the previous update is gone
+  PE_CLOSEST_CHANGED = 1 << 4, // another enemy is the closest one now
+
+  PE_ENEMY_RADIUS = PE_ENEMY_ENTERED | PE_ENEMY_LEFT,
+  PE_ALL = ~0u // polled, anything may have changed
+};
+
+// Radii and hitpoint thresholds the AI of an entity depends on and on which side of them it was
+// at the last update. Conditions that only depend on those are re-checked when one of their events
+// fires instead of on every turn.
+struct Perception
+{
+  static constexpr size_t max_watches = 8;
+
+  float radii[max_watches] = {};
+  float hpThresholds[max_watches] = {};
+  uint8_t numRadii = 0;
+  uint8_t numHpThresholds = 0;
+  bool overflow = false; // ran out of watches, every update reports PE_ALL then
+
+  uint8_t enemyWithin = 0; // bit per radius, closest enemy is within it
+  uint8_t hpBelow = 0; // bit per threshold, hitpoints are below it
+  flecs::entity closestEnemy;
+
+  uint32_t events = PE_ALL; // pending until the decisions of the turn ran, everything is new at first
+
+  void watch_radius(float radius);
+  void watch_hp(float thres);
+};
+
+// turns the world of this turn into perception events, call before decisions
+void update_perception(flecs::world &ecs);
+// decisions saw the events, call after them
+void clear_perception_events(flecs::world &ecs);
@@ -0,0 +1,44 @@
+#include "rng.h"
+#include <random>
+#include <utility>
+
+// splitmix64, cheap to reseed per entity unlike mt19937
+struct SplitMix64
+{
+  using result_type = uint64_t;
+  uint64_t state = 0;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  result_type operator()()
+  {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+};
+
+static uint64_t global_seed = 0;
+static thread_local SplitMix64 generator{global_seed};
+
+void rng::seed(unsigned seed)
+{
+  global_seed = seed;
+  generator.state = seed;
+}
+
+int rng::range(int min, int max)
+{
+  if (min > max)
+    std::swap(min, max);
+  std::uniform_int_distribution<int> dist(min, max);
+  return dist(generator);
+}
+
+void rng::select_stream(uint64_t key)
+{
+  SplitMix64 mix{global_seed ^ key};
+  generator.state = mix();
+}
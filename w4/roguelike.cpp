@@ -1,14 +1,23 @@
 #include "roguelike.h"
 #include "ecsTypes.h"
-#include "raylib.h"
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "monsterTrees.h"
+#include "occupancyIndex.h"
 #include "blackboard.h"
+#include "flatBehTree.h"
+#include "flatStateMachine.h"
+#include "perception.h"
+#include "sensors.h"
 #include "math.h"
 #include "dungeonUtils.h"
 #include "dijkstraMapGen.h"
 #include "dmapFollower.h"
+#include "aiUtils.h"
+#include "rng.h"
+#include "workerPool.h"
 #include <algorithm>
+#include <tuple>
 
 static flecs::entity create_enemy_approacher(flecs::entity e, std::string team)
 {
@@ -53,71 +62,60 @@ static flecs::entity create_explorer(flecs::entity e)
 }
 
 
+// Definitions from monsterTrees are compiled once without an entity and shared by the archetype,
+// a spawn only registers its blackboard keys and gets an inline tree state.
 static void create_fuzzy_monster_beh(flecs::entity e)
 {
-  e.set(Blackboard{});
-  BehNode *root =
-    utility_selector({
-      std::make_pair(
-        sequence({
-          find_enemy(e, 4.f, "flee_enemy"),
-          flee(e, "flee_enemy")
-        }),
-        [](Blackboard &bb)
-        {
-          const float hp = bb.get<float>("hp");
-          const float enemyDist = bb.get<float>("enemyDist");
-          return (100.f - hp) * 5.f - 50.f * enemyDist;
-        }
-      ),
-      std::make_pair(
-        sequence({
-          find_enemy(e, 3.f, "attack_enemy"),
-          move_to_entity(e, "attack_enemy")
-        }),
-        [](Blackboard &bb)
-        {
-          const float enemyDist = bb.get<float>("enemyDist");
-          return 100.f - 10.f * enemyDist;
-        }
-      ),
-      std::make_pair(
-        patrol(e, 2.f, "patrol_pos"),
-        [](Blackboard &)
-        {
-          return 50.f;
-        }
-      ),
-      std::make_pair(
-        patch_up(100.f),
-        [](Blackboard &bb)
-        {
-          const float hp = bb.get<float>("hp");
-          return 140.f - hp;
-        }
-      )
-    });
+  static auto schema = std::make_shared<BlackboardSchema>();
+  e.set(Blackboard{schema});
+  static const std::shared_ptr<const FlatBehTree> tree = compile_beh_tree(make_fuzzy_monster_beh());
+  e.set(Perception{});
+  e.insert([&](Blackboard &bb) { tree->init_entity(e, bb); });
   e.add<WorldInfoGatherer>();
-  e.set(BehaviourTree{root});
+  e.set(FlatBehaviourTree{tree, tree->make_state()});
 }
 
 static void create_minotaur_beh(flecs::entity e)
 {
-  e.set(Blackboard{});
-  BehNode *root =
-    selector({
-      sequence({
-        is_low_hp(50.f),
-        find_enemy(e, 4.f, "flee_enemy"),
-        flee(e, "flee_enemy")
-      }),
-      sequence({
-        find_enemy(e, 3.f, "attack_enemy"),
-        move_to_entity(e, "attack_enemy")
-      }),
-      patrol(e, 2.f, "patrol_pos")
-    });
-  e.set(BehaviourTree{root});
+  static auto schema = std::make_shared<BlackboardSchema>();
+  e.set(Blackboard{schema});
+  static const std::shared_ptr<const FlatBehTree> tree = compile_beh_tree(make_minotaur_beh());
+  e.set(Perception{});
+  e.insert([&](Blackboard &bb) { tree->init_entity(e, bb); });
+  e.set(FlatBehaviourTree{tree, tree->make_state()});
+}
+
+// The machine is built per entity on its StateMachine, transitions watch the Perception of the
+// entity and are only re-checked when one of their events fired.
+static flecs::entity create_patrol_attack_flee_sm(flecs::entity e)
+{
+  Position pos;
+  e.get([&](const Position &p) { pos = p; });
+  e.set(PatrolPos{pos.x, pos.y});
+  e.set(Perception{});
+  e.insert([](StateMachine &sm, Perception &perception)
+  {
+    build_patrol_attack_flee_sm(sm);
+    sm.subscribe(perception);
+  });
+  return e;
+}
+
+// same definition compiled once and shared, entities only keep their state index
+static flecs::entity create_patrol_attack_flee_fsm(flecs::entity e)
+{
+  static const std::shared_ptr<const FlatFsm> fsm = []()
+  {
+    StateMachine sm;
+    build_patrol_attack_flee_sm(sm);
+    return compile_state_machine(sm);
+  }();
+  Position pos;
+  e.get([&](const Position &p) { pos = p; });
+  e.set(PatrolPos{pos.x, pos.y});
+  e.remove<StateMachine>();
+  e.set(FlatStateMachine{fsm, 0});
+  return e;
 }
 
 static Position find_free_dungeon_tile(flecs::world &ecs)
@@ -139,7 +137,7 @@ static Position find_free_dungeon_tile(flecs::world &ecs)
   return {0, 0};
 }
 
-static flecs::entity create_monster(flecs::world &ecs, Color col, const char *texture_src, int team, bool isMage = false)
+static flecs::entity create_monster(flecs::world &ecs, Tint col, const char *texture_src, int team, bool isMage = false)
 {
   Position pos = find_free_dungeon_tile(ecs);
 
@@ -149,9 +147,10 @@ static flecs::entity create_monster(flecs::world &ecs, Color col, const char *te
     .set(MovePos{pos.x, pos.y})
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
-    .set(Color{col})
+    .set(Tint{col})
     .add<TextureSource>(textureSrc)
     .set(StateMachine{})
+    .set(Sensors{})
     .set(Team{team})
     .set(NumActions{1, 0})
     .set(MeleeDamage{ isMage ? 0.f : 20.f })
@@ -163,11 +162,11 @@ static void create_player(flecs::world &ecs, const char *texture_src)
 {
   Position pos = find_free_dungeon_tile(ecs);
 
-  std::vector<bool> expMap;
+  BitGrid expMap;
   static auto dungeonDataQuery = ecs.query<const DungeonData>();
   dungeonDataQuery.each([&](const DungeonData& dd)
   {
-    expMap.resize(dd.height * dd.width);
+    expMap = BitGrid(dd.width, dd.height);
   });
 
   flecs::entity textureSrc = ecs.entity(texture_src);
@@ -175,13 +174,13 @@ static void create_player(flecs::world &ecs, const char *texture_src)
     .set(Position{pos.x, pos.y})
     .set(MovePos{pos.x, pos.y})
     .set(Hitpoints{100.f})
-    //.set(Color{0xee, 0xee, 0xee, 0xff})
+    //.set(Tint{0xee, 0xee, 0xee, 0xff})
     .set(Action{EA_NOP})
     .add<IsPlayer>()
     .set(Team{0})
     .set(PlayerInput{})
     .set(NumActions{2, 0})
-    .set(Color{255, 255, 255, 255})
+    .set(Tint{255, 255, 255, 255})
     .add<TextureSource>(textureSrc)
     .set(MeleeDamage{20.f})
     .set(ExplorationMap{expMap});
@@ -192,7 +191,7 @@ static void create_heal(flecs::world &ecs, int x, int y, float amount)
   ecs.entity()
     .set(Position{x, y})
     .set(HealAmount{amount})
-    .set(Color{0xff, 0x44, 0x44, 0xff});
+    .set(Tint{0xff, 0x44, 0x44, 0xff});
 }
 
 static void create_powerup(flecs::world &ecs, int x, int y, float amount)
@@ -200,166 +199,54 @@ static void create_powerup(flecs::world &ecs, int x, int y, float amount)
   ecs.entity()
     .set(Position{x, y})
     .set(PowerupAmount{amount})
-    .set(Color{0xff, 0xff, 0x00, 0xff});
+    .set(Tint{0xff, 0xff, 0x00, 0xff});
 }
 
-static void register_roguelike_systems(flecs::world &ecs)
+void apply_player_input(flecs::world &ecs, const PlayerInput &keys)
 {
-  static auto dungeonDataQuery = ecs.query<const DungeonData>();
-  ecs.system<PlayerInput, Action, const IsPlayer>()
-    .each([&](flecs::entity e, PlayerInput &inp, Action &a, const IsPlayer)
-    {
-      bool left = IsKeyDown(KEY_LEFT);
-      bool right = IsKeyDown(KEY_RIGHT);
-      bool up = IsKeyDown(KEY_UP);
-      bool down = IsKeyDown(KEY_DOWN);
-      bool explore = IsKeyDown(KEY_E);
-      inp.explore = explore;
-      if (explore)
-      {
-        a.action = EA_EXPLORE;
-        create_explorer(e);
-        return;
-      }
-      else
-        e.remove<DmapWeights>();
-
-      if (left && !inp.left)
-        a.action = EA_MOVE_LEFT;
-      if (right && !inp.right)
-        a.action = EA_MOVE_RIGHT;
-      if (up && !inp.up)
-        a.action = EA_MOVE_UP;
-      if (down && !inp.down)
-        a.action = EA_MOVE_DOWN;
-      inp.left = left;
-      inp.right = right;
-      inp.up = up;
-      inp.down = down;
-
-      bool pass = IsKeyDown(KEY_SPACE);
-      if (pass && !inp.passed)
-        a.action = EA_PASS;
-      inp.passed = pass;
-    });
-  ecs.system<const Position, const Color>()
-    .with<TextureSource>(flecs::Wildcard)
-    .with<BackgroundTile>()
-    .each([&](flecs::entity e, const Position &pos, const Color color)
-    {
-      const auto textureSrc = e.target<TextureSource>();
-      DrawTextureQuad(*textureSrc.get<Texture2D>(),
-          Vector2{1, 1}, Vector2{0, 0},
-          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, color);
-    });
-  ecs.system<const Position, const Color>()
-    .without<TextureSource>(flecs::Wildcard)
-    .each([&](const Position &pos, const Color color)
-    {
-      const Rectangle rect = {float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size};
-      DrawRectangleRec(rect, color);
-    });
-  ecs.system<const Position, const Color>()
-    .with<TextureSource>(flecs::Wildcard)
-    .without<BackgroundTile>()
-    .each([&](flecs::entity e, const Position &pos, const Color color)
-    {
-      const auto textureSrc = e.target<TextureSource>();
-      DrawTextureQuad(*textureSrc.get<Texture2D>(),
-          Vector2{1, 1}, Vector2{0, 0},
-          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, color);
-    });
-  ecs.system<const Position, const Hitpoints>()
-    .each([&](const Position &pos, const Hitpoints &hp)
-    {
-      constexpr float hpPadding = 0.05f;
-      const float hpWidth = 1.f - 2.f * hpPadding;
-      const Rectangle underRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
-                                   hpWidth * tile_size, 0.1f * tile_size};
-      DrawRectangleRec(underRect, BLACK);
-      const Rectangle hpRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
-                                hp.hitpoints / 100.f * hpWidth * tile_size, 0.1f * tile_size};
-      DrawRectangleRec(hpRect, RED);
-    });
-
-  ecs.system<Texture2D>()
-    .each([&](Texture2D &tex)
-    {
-      SetTextureFilter(tex, TEXTURE_FILTER_POINT);
-    });
-  ecs.system<const DmapWeights>()
-    .with<VisualiseMap>()
-    .each([&](const DmapWeights &wt)
-    {
-      dungeonDataQuery.each([&](const DungeonData &dd)
-      {
-        for (size_t y = 0; y < dd.height; ++y)
-          for (size_t x = 0; x < dd.width; ++x)
-          {
-            float sum = 0.f;
-            for (const auto &pair : wt.weights)
-            {
-              ecs.entity(pair.first.c_str()).get([&](const DijkstraMapData &dmap)
-              {
-                float v = dmap.map[y * dd.width + x];
-                if (v < 1e5f)
-                  sum += powf(v * pair.second.mult, pair.second.pow);
-                else
-                  sum += v;
-              });
-            }
-            if (sum < 1e5f)
-              DrawText(TextFormat("%.1f", sum),
-                  (float(x) + 0.2f) * tile_size, (float(y) + 0.5f) * tile_size, 150, WHITE);
-          }
-      });
-    });
-  ecs.system<const DijkstraMapData>()
-    .with<VisualiseMap>()
-    .each([](const DijkstraMapData &dmap)
+  static auto playerInputQuery = ecs.query<PlayerInput, Action, const IsPlayer>();
+  playerInputQuery.each([&](flecs::entity e, PlayerInput &inp, Action &a, const IsPlayer)
+  {
+    inp.explore = keys.explore;
+    if (keys.explore)
     {
-      dungeonDataQuery.each([&](const DungeonData &dd)
-      {
-        for (size_t y = 0; y < dd.height; ++y)
-          for (size_t x = 0; x < dd.width; ++x)
-          {
-            const float val = dmap.map[y * dd.width + x];
-            if (val < 1e5f)
-              DrawText(TextFormat("%.1f", val),
-                  (float(x) + 0.2f) * tile_size, (float(y) + 0.5f) * tile_size, 150, WHITE);
-          }
-      });
-    });
+      a.action = EA_EXPLORE;
+      create_explorer(e);
+      return;
+    }
+    else
+      e.remove<DmapWeights>();
+
+    if (keys.left && !inp.left)
+      a.action = EA_MOVE_LEFT;
+    if (keys.right && !inp.right)
+      a.action = EA_MOVE_RIGHT;
+    if (keys.up && !inp.up)
+      a.action = EA_MOVE_UP;
+    if (keys.down && !inp.down)
+      a.action = EA_MOVE_DOWN;
+    inp.left = keys.left;
+    inp.right = keys.right;
+    inp.up = keys.up;
+    inp.down = keys.down;
+
+    if (keys.passed && !inp.passed)
+      a.action = EA_PASS;
+    inp.passed = keys.passed;
+  });
 }
 
-
 void init_roguelike(flecs::world &ecs)
 {
-  register_roguelike_systems(ecs);
+  create_enemy_approacher(create_monster(ecs, Tint{0x00, 0xee, 0xee, 0xff}, "minotaur_tex", 1), "1");
+  create_enemy_approacher(create_monster(ecs, Tint{0x00, 0xee, 0xee, 0xff}, "minotaur_tex", 1), "1");
+  create_enemy_range_approacher(create_monster(ecs, Tint{0x00, 0xee, 0xee, 0xff}, "mage_tex", 1, true), "1");
+  //create_enemy_range_approacher(create_monster(ecs, Tint{0x00, 0xee, 0xee, 0xff}, "mage_tex", 1, true));
 
-  ecs.entity("swordsman_tex")
-    .set(Texture2D{LoadTexture("assets/swordsman.png")});
-  ecs.entity("minotaur_tex")
-    .set(Texture2D{LoadTexture("assets/minotaur.png")});
-  ecs.entity("mage_tex")
-    .set(Texture2D{LoadTexture("assets/mage.png")});
-
-  ecs.observer<Texture2D>()
-    .event(flecs::OnRemove)
-    .each([](Texture2D texture)
-      {
-        UnloadTexture(texture);
-      });
-
-  create_enemy_approacher(create_monster(ecs, Color{0x00, 0xee, 0xee, 0xff}, "minotaur_tex", 1), "1");
-  create_enemy_approacher(create_monster(ecs, Color{0x00, 0xee, 0xee, 0xff}, "minotaur_tex", 1), "1");
-  create_enemy_range_approacher(create_monster(ecs, Color{0x00, 0xee, 0xee, 0xff}, "mage_tex", 1, true), "1");
-  //create_enemy_range_approacher(create_monster(ecs, Color{0x00, 0xee, 0xee, 0xff}, "mage_tex", 1, true));
-
-  create_hive_monster(create_monster(ecs, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
-  create_hive_monster(create_monster(ecs, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
-  create_hive_monster(create_monster(ecs, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
-  create_hive(create_enemy_fleer(create_monster(ecs, Color{0, 255, 0, 255}, "minotaur_tex", 2), "2"));
+  create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
+  create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
+  create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
+  create_hive(create_enemy_fleer(create_monster(ecs, Tint{0, 255, 0, 255}, "minotaur_tex", 2), "2"));
 
   create_player(ecs, "swordsman_tex");
 
@@ -368,13 +255,30 @@ void init_roguelike(flecs::world &ecs)
     .set(ActionLog{});
 }
 
-void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
+void add_monster_horde(flecs::world &ecs, size_t num_monsters)
+{
+  for (size_t i = 0; i < num_monsters; ++i)
+  {
+    if (i % 2 == 0)
+      create_enemy_approacher(create_monster(ecs, Tint{0x00, 0xee, 0xee, 0xff}, "minotaur_tex", 1), "1");
+    else
+      create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex", 2), "2");
+  }
+}
+
+void add_ai_archetypes(flecs::world &ecs, size_t num_each)
 {
-  flecs::entity wallTex = ecs.entity("wall_tex")
-    .set(Texture2D{LoadTexture("assets/wall.png")});
-  flecs::entity floorTex = ecs.entity("floor_tex")
-    .set(Texture2D{LoadTexture("assets/floor.png")});
+  for (size_t i = 0; i < num_each; ++i)
+  {
+    create_patrol_attack_flee_sm(create_monster(ecs, Tint{0xee, 0xee, 0x00, 0xff}, "minotaur_tex", 1));
+    create_patrol_attack_flee_fsm(create_monster(ecs, Tint{0xee, 0xee, 0x00, 0xff}, "minotaur_tex", 1));
+    create_minotaur_beh(create_monster(ecs, Tint{0xee, 0xee, 0x00, 0xff}, "minotaur_tex", 1));
+    create_fuzzy_monster_beh(create_monster(ecs, Tint{0xee, 0xee, 0x00, 0xff}, "minotaur_tex", 1));
+  }
+}
 
+void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
+{
   std::vector<char> dungeonData;
   dungeonData.resize(w * h);
   for (size_t y = 0; y < h; ++y)
@@ -382,20 +286,6 @@ void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
       dungeonData[y * w + x] = tiles[y * w + x];
   ecs.entity("dungeon")
     .set(DungeonData{dungeonData, w, h});
-
-  for (size_t y = 0; y < h; ++y)
-    for (size_t x = 0; x < w; ++x)
-    {
-      char tile = tiles[y * w + x];
-      flecs::entity tileEntity = ecs.entity()
-        .add<BackgroundTile>()
-        .set(Position{int(x), int(y)})
-        .set(Color{255, 255, 255, 255});
-      if (tile == dungeon::wall)
-        tileEntity.add<TextureSource>(wallTex);
-      else if (tile == dungeon::floor)
-        tileEntity.add<TextureSource>(floorTex);
-    }
 }
 
 
@@ -451,6 +341,7 @@ static void process_actions(flecs::world &ecs)
   static auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
   static auto processHeals = ecs.query<Action, Hitpoints>();
   static auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
+  static OccupancyIndex occupancy;
   static auto processRangeAttacks = ecs.query<const Action, Position, const MagicDamage, const Team>();
   // Process all actions
   ecs.defer([&]
@@ -464,26 +355,34 @@ static void process_actions(flecs::world &ecs)
       hp.hitpoints += 10.f;
 
     });
+    occupancy.clear();
+    checkAttacks.each([&](flecs::entity entity, const MovePos &mpos, Hitpoints &hp, const Team &team)
+    {
+      occupancy.add(mpos, {entity, &hp, team.team});
+    });
     processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
     {
       Position nextPos = move_pos(pos, a.action);
       bool blocked = !dungeon::is_tile_walkable(ecs, nextPos);
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      occupancy.each(nextPos, [&](OccupancyIndex::Occupant &occ)
       {
-        if (entity != enemy && epos == nextPos)
+        if (occ.entity != entity)
         {
           blocked = true;
-          if (team.team != enemy_team.team)
+          if (team.team != occ.team)
           {
             push_to_log(ecs, "damaged entity");
-            hp.hitpoints -= dmg.damage;
+            occ.hp->hitpoints -= dmg.damage;
           }
         }
       });
       if (blocked)
         a.action = EA_NOP;
       else
+      {
+        occupancy.move(entity, mpos, nextPos);
         mpos = nextPos;
+      }
     });
     processRangeAttacks.each([&](flecs::entity entity, const Action& a, Position& pos, const MagicDamage& dmg, const Team& team)
     {
@@ -541,151 +440,251 @@ static void process_actions(flecs::world &ecs)
 }
 
 template<typename T>
-static void push_info_to_bb(Blackboard &bb, const char *name, const T &val)
+static void push_info_to_bb(Blackboard &bb, size_t key, const T &val)
 {
-  size_t idx = bb.regName<T>(name);
-  bb.set(idx, val);
+  bb.regKey<T>(key);
+  bb.set(key, val);
 }
 
 // sensors
 static void gather_world_info(flecs::world &ecs)
 {
   static auto gatherWorldInfo = ecs.query<Blackboard,
-                                          const Position, const Hitpoints,
-                                          const WorldInfoGatherer,
-                                          const Team>();
-  static auto alliesQuery = ecs.query<const Position, const Team>();
-  gatherWorldInfo.each([&](Blackboard &bb, const Position &pos, const Hitpoints &hp,
-                           WorldInfoGatherer, const Team &team)
+                                          const Hitpoints,
+                                          const Sensors,
+                                          const WorldInfoGatherer>();
+  static const size_t hpBb = bb_key<float>("hp");
+  static const size_t alliesNumBb = bb_key<float>("alliesNum");
+  static const size_t enemyDistBb = bb_key<float>("enemyDist");
+  gatherWorldInfo.each([&](Blackboard &bb, const Hitpoints &hp, const Sensors &sensors, WorldInfoGatherer)
+  {
+    push_info_to_bb(bb, hpBb, hp.hitpoints);
+    push_info_to_bb(bb, alliesNumBb, sensors.alliesNearby); // note float
+    push_info_to_bb(bb, enemyDistBb, std::min(sensors.closestEnemyDist, 100.f));
+  });
+}
+
+template<typename Callable>
+static void run_ranges_on_stages(flecs::world &ecs, size_t count, Callable c)
+{
+  const size_t numWorkers = jobs::num_workers();
+  ecs.readonly_begin(numWorkers > 1);
+  jobs::parallel_for(count, [&](size_t worker, size_t begin, size_t end)
   {
-    // first gather all needed names (without cache)
-    push_info_to_bb(bb, "hp", hp.hitpoints);
-    float numAllies = 0; // note float
-    float closestEnemyDist = 100.f;
-    alliesQuery.each([&](const Position &apos, const Team &ateam)
+    flecs::world stage = ecs.get_stage(int32_t(worker));
+    c(stage, begin, end);
+  });
+  ecs.readonly_end();
+}
+
+template<typename Callable>
+static void run_on_stages(flecs::world &ecs, size_t count, Callable c)
+{
+  run_ranges_on_stages(ecs, count, [&](flecs::world &stage, size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+      c(stage, i);
+  });
+}
+
+// Decisions only read the world and write components of their own entity. They run on
+// worker stages in readonly mode, so every NPC sees the same frozen world and the writes
+// are merged afterwards. Random draws are keyed per entity and turn, so the outcome
+// doesn't depend on the number of workers.
+static void plan_npc_actions(flecs::world &ecs)
+{
+  static auto stateMachineAct = ecs.query<StateMachine, const Perception*>();
+  static auto behTreeUpdate = ecs.query<BehaviourTree, Blackboard>();
+  static auto flatTreeUpdate = ecs.query<FlatBehaviourTree, Blackboard, const Perception*>();
+  static auto flatFsmUpdate = ecs.query<FlatStateMachine>();
+  static auto turnQuery = ecs.query<const TurnCounter>();
+
+  uint64_t turn = 0;
+  turnQuery.each([&](const TurnCounter &tc) { turn = uint64_t(tc.count); });
+  auto select_rng_stream = [&](flecs::entity e)
+  {
+    rng::select_stream(turn * 0x9e3779b97f4a7c15ull ^ e.id());
+  };
+
+  team_positions_query(ecs); // shared queries can't be created from worker stages
+  const int32_t numStages = int32_t(jobs::num_workers());
+  if (ecs.get_stage_count() != numStages)
+    ecs.set_stage_count(numStages);
+
+  // component pointers stay valid while the world is readonly
+  // entities without a Perception see every event, idle machines are skipped
+  std::vector<std::tuple<flecs::entity, StateMachine*, uint32_t>> machines;
+  stateMachineAct.each([&](flecs::entity e, StateMachine &sm, const Perception *perception)
+  {
+    const uint32_t events = perception ? perception->events : PE_ALL;
+    if (!sm.isIdle(events))
+      machines.emplace_back(e, &sm, events);
+  });
+  run_on_stages(ecs, machines.size(), [&](flecs::world &stage, size_t i)
+  {
+    auto [e, sm, events] = machines[i];
+    select_rng_stream(e);
+    sm->act(0.f, stage, e.mut(stage), events);
+  });
+
+  // flat machines are ticked in runs of entities sharing a machine and a state
+  std::vector<std::tuple<const FlatFsm*, uint32_t, flecs::entity, uint32_t*>> flatMachines;
+  flatFsmUpdate.each([&](flecs::entity e, FlatStateMachine &sm)
+  {
+    flatMachines.emplace_back(sm.fsm.get(), sm.state, e, &sm.state);
+  });
+  std::stable_sort(flatMachines.begin(), flatMachines.end(), [](const auto &lhs, const auto &rhs)
+  {
+    return std::tie(std::get<0>(lhs), std::get<1>(lhs)) < std::tie(std::get<0>(rhs), std::get<1>(rhs));
+  });
+  std::vector<flecs::entity> flatMachineEntities(flatMachines.size());
+  std::vector<uint32_t*> flatMachineStates(flatMachines.size());
+  for (size_t i = 0; i < flatMachines.size(); ++i)
+  {
+    flatMachineEntities[i] = std::get<2>(flatMachines[i]);
+    flatMachineStates[i] = std::get<3>(flatMachines[i]);
+  }
+  run_ranges_on_stages(ecs, flatMachines.size(), [&](flecs::world &stage, size_t begin, size_t end)
+  {
+    while (begin < end)
     {
-      constexpr float limitDist = 5.f;
-      if (team.team == ateam.team && dist_sq(pos, apos) < sqr(limitDist))
-        numAllies += 1.f;
-      if (team.team != ateam.team)
-      {
-        const float enemyDist = dist(pos, apos);
-        if (enemyDist < closestEnemyDist)
-          closestEnemyDist = enemyDist;
-      }
-    });
-    push_info_to_bb(bb, "alliesNum", numAllies);
-    push_info_to_bb(bb, "enemyDist", closestEnemyDist);
+      const FlatFsm *fsm = std::get<0>(flatMachines[begin]);
+      const uint32_t state = std::get<1>(flatMachines[begin]);
+      size_t runEnd = begin + 1;
+      while (runEnd < end && std::get<0>(flatMachines[runEnd]) == fsm && std::get<1>(flatMachines[runEnd]) == state)
+        ++runEnd;
+      fsm->tick(stage, state, flatMachineEntities.data() + begin, flatMachineStates.data() + begin,
+                runEnd - begin, select_rng_stream);
+      begin = runEnd;
+    }
+  });
+
+  // gathered after the merge, it may have moved entities between tables
+  std::vector<std::tuple<flecs::entity, BehaviourTree*, Blackboard*>> trees;
+  behTreeUpdate.each([&](flecs::entity e, BehaviourTree &bt, Blackboard &bb)
+  {
+    trees.emplace_back(e, &bt, &bb);
+  });
+  run_on_stages(ecs, trees.size(), [&](flecs::world &stage, size_t i)
+  {
+    auto [e, bt, bb] = trees[i];
+    select_rng_stream(e);
+    bt->update(stage, e.mut(stage), *bb);
+  });
+
+  // flat trees are ticked in runs of entities sharing a tree
+  std::vector<std::tuple<const FlatBehTree*, flecs::entity, Blackboard*, FlatTreeState*>> flatTrees;
+  flatTreeUpdate.each([&](flecs::entity e, FlatBehaviourTree &bt, Blackboard &bb, const Perception *perception)
+  {
+    bt.state.events = perception ? perception->events : PE_ALL;
+    flatTrees.emplace_back(bt.tree.get(), e, &bb, &bt.state);
+  });
+  std::stable_sort(flatTrees.begin(), flatTrees.end(),
+                   [](const auto &lhs, const auto &rhs) { return std::get<0>(lhs) < std::get<0>(rhs); });
+  std::vector<flecs::entity> flatEntities(flatTrees.size());
+  std::vector<Blackboard*> flatBbs(flatTrees.size());
+  std::vector<FlatTreeState*> flatStates(flatTrees.size());
+  for (size_t i = 0; i < flatTrees.size(); ++i)
+  {
+    flatEntities[i] = std::get<1>(flatTrees[i]);
+    flatBbs[i] = std::get<2>(flatTrees[i]);
+    flatStates[i] = std::get<3>(flatTrees[i]);
+  }
+  run_ranges_on_stages(ecs, flatTrees.size(), [&](flecs::world &stage, size_t begin, size_t end)
+  {
+    while (begin < end)
+    {
+      const FlatBehTree *tree = std::get<0>(flatTrees[begin]);
+      size_t runEnd = begin + 1;
+      while (runEnd < end && std::get<0>(flatTrees[runEnd]) == tree)
+        ++runEnd;
+      tree->tick(stage, flatEntities.data() + begin, flatBbs.data() + begin, flatStates.data() + begin,
+                 runEnd - begin, select_rng_stream);
+      begin = runEnd;
+    }
   });
 }
 
+constexpr int exploration_radius = 6;
+
+// half widths of the rows of a disk, explorers mark it as seen around them
+struct DiskStencil
+{
+  int halfWidth[2 * exploration_radius + 1] = {};
+};
+
+static constexpr DiskStencil make_disk_stencil()
+{
+  DiskStencil stencil;
+  for (int dy = -exploration_radius; dy <= exploration_radius; ++dy)
+  {
+    int hw = 0;
+    while ((hw + 1) * (hw + 1) + dy * dy <= exploration_radius * exploration_radius)
+      ++hw;
+    stencil.halfWidth[dy + exploration_radius] = hw;
+  }
+  return stencil;
+}
+
+static constexpr DiskStencil exploration_stencil = make_disk_stencil();
+
+static void stamp_explored(BitGrid &explored, const Position &pos)
+{
+  for (int dy = -exploration_radius; dy <= exploration_radius; ++dy)
+  {
+    const int y = pos.y + dy;
+    if (y < 0 || y >= int(explored.height()))
+      continue;
+    const int hw = exploration_stencil.halfWidth[dy + exploration_radius];
+    const int x0 = std::max(pos.x - hw, 0);
+    const int x1 = std::min(pos.x + hw, int(explored.width()) - 1);
+    if (x0 <= x1)
+      explored.set_span(size_t(y), size_t(x0), size_t(x1));
+  }
+}
+
 void process_turn(flecs::world &ecs)
 {
-  static auto stateMachineAct = ecs.query<StateMachine>();
-  static auto behTreeUpdate = ecs.query<BehaviourTree, Blackboard>();
   static auto turnIncrementer = ecs.query<TurnCounter>();
   if (is_player_acted(ecs))
   {
     if (upd_player_actions_count(ecs))
     {
       // Plan action for NPCs
+      update_sensors(ecs);
       gather_world_info(ecs);
-      ecs.defer([&]
-      {
-        stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
-        {
-          sm.act(0.f, ecs, e);
-        });
-        behTreeUpdate.each([&](flecs::entity e, BehaviourTree &bt, Blackboard &bb)
-        {
-          bt.update(ecs, e, bb);
-        });
-        process_dmap_followers(ecs);
-      });
+      update_perception(ecs);
+      plan_npc_actions(ecs);
+      clear_perception_events(ecs);
+      process_dmap_followers(ecs);
       turnIncrementer.each([](TurnCounter &tc) { tc.count++; });
     }
     process_actions(ecs);
 
-    static auto dungeonDataQuery = ecs.query<const DungeonData>();
-    dungeonDataQuery.each([&](const DungeonData& dd) {
-      static auto exp = ecs.query<ExplorationMap, const Position>();
-      exp.each([&](ExplorationMap& expMap, const Position& pos)
-      {
-        int expDist = 6;
-        int yStart = std::max(pos.y - expDist, 0);
-        int yEnd = std::min(pos.y + expDist, int(dd.width) - 1);
-        int xStart = std::max(pos.x - expDist, 0);
-        int xEnd = std::min(pos.x + expDist, int(dd.height) - 1);
-        for (int y = yStart; y < yEnd; ++y)
-          for (int x = xStart; x < xEnd; ++x)
-          {
-            if (dist(pos, Position{x, y}) <= expDist)
-              expMap.explored[y * dd.width + x] = true;
-          }
-      });
+    static auto exp = ecs.query<ExplorationMap, const Position>();
+    exp.each([&](ExplorationMap &expMap, const Position &pos)
+    {
+      stamp_explored(expMap.explored, pos);
     });
 
-    std::vector<float> approachMap1;
-    dmaps::gen_enemy_approach_map(ecs, approachMap1, 1);
-    ecs.entity("approach_map1")
-      .set(DijkstraMapData{approachMap1});
-
-    std::vector<float> fleeMap1;
-    dmaps::gen_enemy_flee_map(ecs, fleeMap1, 1);
-    ecs.entity("flee_map1")
-      .set(DijkstraMapData{fleeMap1});
-
-    std::vector<float> mageMap1;
-    dmaps::gen_enemy_mage_map(ecs, mageMap1, 1.999f, 4.999f, 1);
-    ecs.entity("mage_map1")
-      .set(DijkstraMapData{mageMap1});
-
-    std::vector<float> approachMap2;
-    dmaps::gen_enemy_approach_map(ecs, approachMap2, 2);
-    ecs.entity("approach_map2")
-      .set(DijkstraMapData{approachMap2});
-
-    std::vector<float> fleeMap2;
-    dmaps::gen_enemy_flee_map(ecs, fleeMap2, 2);
-    ecs.entity("flee_map2")
-      .set(DijkstraMapData{fleeMap2});
-
-    std::vector<float> hiveMap2;
-    dmaps::gen_hive_pack_map(ecs, hiveMap2);
-    ecs.entity("hive_map2")
-      .set(DijkstraMapData{hiveMap2});
+    // approach, hive and exploration maps persist between turns and are only repaired
+    // around sources that moved, flee and mage maps are seeded everywhere and get rebuilt
+    static const std::vector<dmaps::MapRequest> dmapRequests = {
+      {ecs.entity("approach_map1"), dmaps::MapKind::EnemyApproach, 1},
+      {ecs.entity("flee_map1"), dmaps::MapKind::EnemyFlee, 1},
+      {ecs.entity("mage_map1"), dmaps::MapKind::EnemyMage, 1, 1.999f, 4.999f},
+      {ecs.entity("approach_map2"), dmaps::MapKind::EnemyApproach, 2},
+      {ecs.entity("flee_map2"), dmaps::MapKind::EnemyFlee, 2},
+      {ecs.entity("hive_map2"), dmaps::MapKind::HivePack},
+      {ecs.entity("explore_map"), dmaps::MapKind::Exploration}
+    };
+    dmaps::gen_maps(ecs, dmapRequests);
 
     //ecs.entity("flee_map").add<VisualiseMap>();
     ecs.entity("hive_follower_sum")
       //.set(DmapWeights{{{"flee_map", {1.f, 1.f}}}})
       .set(DmapWeights{{{"hive_map2", {1.f, 1.f}}, {"approach_map", {1.8f, 0.8f}}}});
     
-    std::vector<float> explorationMap;
-    dmaps::gen_exploration_map(ecs, explorationMap);
-    ecs.entity("explore_map")
-      .set(DijkstraMapData{explorationMap})
-      .add<VisualiseMap>();
+    ecs.entity("explore_map").add<VisualiseMap>();
   }
 }
-
-void print_stats(flecs::world &ecs)
-{
-  static auto playerStatsQuery = ecs.query<const IsPlayer, const Hitpoints, const MeleeDamage>();
-  playerStatsQuery.each([&](const IsPlayer &, const Hitpoints &hp, const MeleeDamage &dmg)
-  {
-    DrawText(TextFormat("hp: %d", int(hp.hitpoints)), 20, 20, 20, WHITE);
-    DrawText(TextFormat("power: %d", int(dmg.damage)), 20, 40, 20, WHITE);
-  });
-
-  static auto actionLogQuery = ecs.query<const ActionLog>();
-  actionLogQuery.each([&](const ActionLog &l)
-  {
-    int yPos = GetRenderHeight() - 20;
-    for (const std::string &msg : l.log)
-    {
-      DrawText(msg.c_str(), 20, yPos, 20, WHITE);
-      yPos -= 20;
-    }
-  });
-}
-
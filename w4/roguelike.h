@@ -1,10 +1,14 @@
 #pragma once
 
 #include <flecs.h>
-
-constexpr float tile_size = 512.f;
+#include "ecsTypes.h"
 
 void init_roguelike(flecs::world &ecs);
 void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h);
+void add_monster_horde(flecs::world &ecs, size_t num_monsters);
+// opt-in, num_each team 1 monsters of every AI archetype the default game doesn't spawn:
+// a per-entity state machine subscribed to its perception, the same machine compiled flat, a
+// minotaur behaviour tree and a fuzzy monster scored with batched linear utilities
+void add_ai_archetypes(flecs::world &ecs, size_t num_each);
+void apply_player_input(flecs::world &ecs, const PlayerInput &keys);
 void process_turn(flecs::world &ecs);
-void print_stats(flecs::world &ecs);
@@ -0,0 +1,182 @@
+#include "roguelikeRender.h"
+#include "ecsTypes.h"
+#include "dungeonUtils.h"
+#include <cmath>
+
+static Color to_color(const Tint &tint)
+{
+  return Color{tint.r, tint.g, tint.b, tint.a};
+}
+
+static void register_render_systems(flecs::world &ecs)
+{
+  static auto dungeonDataQuery = ecs.query<const DungeonData>();
+  ecs.system<const Position, const Tint>()
+    .with<TextureSource>(flecs::Wildcard)
+    .with<BackgroundTile>()
+    .each([&](flecs::entity e, const Position &pos, const Tint tint)
+    {
+      const auto textureSrc = e.target<TextureSource>();
+      DrawTextureQuad(*textureSrc.get<Texture2D>(),
+          Vector2{1, 1}, Vector2{0, 0},
+          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, to_color(tint));
+    });
+  ecs.system<const Position, const Tint>()
+    .without<TextureSource>(flecs::Wildcard)
+    .each([&](const Position &pos, const Tint tint)
+    {
+      const Rectangle rect = {float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size};
+      DrawRectangleRec(rect, to_color(tint));
+    });
+  ecs.system<const Position, const Tint>()
+    .with<TextureSource>(flecs::Wildcard)
+    .without<BackgroundTile>()
+    .each([&](flecs::entity e, const Position &pos, const Tint tint)
+    {
+      const auto textureSrc = e.target<TextureSource>();
+      DrawTextureQuad(*textureSrc.get<Texture2D>(),
+          Vector2{1, 1}, Vector2{0, 0},
+          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, to_color(tint));
+    });
+  ecs.system<const Position, const Hitpoints>()
+    .each([&](const Position &pos, const Hitpoints &hp)
+    {
+      constexpr float hpPadding = 0.05f;
+      const float hpWidth = 1.f - 2.f * hpPadding;
+      const Rectangle underRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
+                                   hpWidth * tile_size, 0.1f * tile_size};
+      DrawRectangleRec(underRect, BLACK);
+      const Rectangle hpRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
+                                hp.hitpoints / 100.f * hpWidth * tile_size, 0.1f * tile_size};
+      DrawRectangleRec(hpRect, RED);
+    });
+
+  ecs.system<Texture2D>()
+    .each([&](Texture2D &tex)
+    {
+      SetTextureFilter(tex, TEXTURE_FILTER_POINT);
+    });
+  ecs.system<const DmapWeights>()
+    .with<VisualiseMap>()
+    .each([&](const DmapWeights &wt)
+    {
+      dungeonDataQuery.each([&](const DungeonData &dd)
+      {
+        for (size_t y = 0; y < dd.height; ++y)
+          for (size_t x = 0; x < dd.width; ++x)
+          {
+            float sum = 0.f;
+            for (const auto &pair : wt.weights)
+            {
+              ecs.entity(pair.first.c_str()).get([&](const DijkstraMapData &dmap)
+              {
+                float v = dmap.at(y * dd.width + x);
+                if (v < 1e5f)
+                  sum += powf(v * pair.second.mult, pair.second.pow);
+                else
+                  sum += v;
+              });
+            }
+            if (sum < 1e5f)
+              DrawText(TextFormat("%.1f", sum),
+                  (float(x) + 0.2f) * tile_size, (float(y) + 0.5f) * tile_size, 150, WHITE);
+          }
+      });
+    });
+  ecs.system<const DijkstraMapData>()
+    .with<VisualiseMap>()
+    .each([](const DijkstraMapData &dmap)
+    {
+      dungeonDataQuery.each([&](const DungeonData &dd)
+      {
+        for (size_t y = 0; y < dd.height; ++y)
+          for (size_t x = 0; x < dd.width; ++x)
+          {
+            const float val = dmap.at(y * dd.width + x);
+            if (val < 1e5f)
+              DrawText(TextFormat("%.1f", val),
+                  (float(x) + 0.2f) * tile_size, (float(y) + 0.5f) * tile_size, 150, WHITE);
+          }
+      });
+    });
+}
+
+
+void init_roguelike_render(flecs::world &ecs)
+{
+  register_render_systems(ecs);
+
+  ecs.entity("swordsman_tex")
+    .set(Texture2D{LoadTexture("assets/swordsman.png")});
+  ecs.entity("minotaur_tex")
+    .set(Texture2D{LoadTexture("assets/minotaur.png")});
+  ecs.entity("mage_tex")
+    .set(Texture2D{LoadTexture("assets/mage.png")});
+
+  ecs.observer<Texture2D>()
+    .event(flecs::OnRemove)
+    .each([](Texture2D texture)
+      {
+        UnloadTexture(texture);
+      });
+}
+
+void init_dungeon_render(flecs::world &ecs)
+{
+  flecs::entity wallTex = ecs.entity("wall_tex")
+    .set(Texture2D{LoadTexture("assets/wall.png")});
+  flecs::entity floorTex = ecs.entity("floor_tex")
+    .set(Texture2D{LoadTexture("assets/floor.png")});
+
+  static auto dungeonDataQuery = ecs.query<const DungeonData>();
+  dungeonDataQuery.each([&](const DungeonData &dd)
+  {
+    for (size_t y = 0; y < dd.height; ++y)
+      for (size_t x = 0; x < dd.width; ++x)
+      {
+        char tile = dd.tiles[y * dd.width + x];
+        flecs::entity tileEntity = ecs.entity()
+          .add<BackgroundTile>()
+          .set(Position{int(x), int(y)})
+          .set(Tint{255, 255, 255, 255});
+        if (tile == dungeon::wall)
+          tileEntity.add<TextureSource>(wallTex);
+        else if (tile == dungeon::floor)
+          tileEntity.add<TextureSource>(floorTex);
+      }
+  });
+}
+
+PlayerInput read_keyboard_input()
+{
+  PlayerInput keys;
+  keys.left = IsKeyDown(KEY_LEFT);
+  keys.right = IsKeyDown(KEY_RIGHT);
+  keys.up = IsKeyDown(KEY_UP);
+  keys.down = IsKeyDown(KEY_DOWN);
+  keys.passed = IsKeyDown(KEY_SPACE);
+  keys.explore = IsKeyDown(KEY_E);
+  return keys;
+}
+
+void print_stats(flecs::world &ecs)
+{
+  static auto playerStatsQuery = ecs.query<const IsPlayer, const Hitpoints, const MeleeDamage>();
+  playerStatsQuery.each([&](const IsPlayer &, const Hitpoints &hp, const MeleeDamage &dmg)
+  {
+    DrawText(TextFormat("hp: %d", int(hp.hitpoints)), 20, 20, 20, WHITE);
+    DrawText(TextFormat("power: %d", int(dmg.damage)), 20, 40, 20, WHITE);
+  });
+
+  static auto actionLogQuery = ecs.query<const ActionLog>();
+  actionLogQuery.each([&](const ActionLog &l)
+  {
+    int yPos = GetRenderHeight() - 20;
+    for (const std::string &msg : l.log)
+    {
+      DrawText(msg.c_str(), 20, yPos, 20, WHITE);
+      yPos -= 20;
+    }
+  });
+}
+
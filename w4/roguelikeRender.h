@@ -0,0 +1,13 @@
+#pragma once
+
+#include <flecs.h>
+#include "raylib.h"
+#include "ecsTypes.h"
+
+constexpr float tile_size = 512.f;
+
+// everything that needs a window lives here, turn logic is in roguelike.h
+void init_roguelike_render(flecs::world &ecs);
+void init_dungeon_render(flecs::world &ecs);
+PlayerInput read_keyboard_input();
+void print_stats(flecs::world &ecs);
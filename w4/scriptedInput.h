@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include "ecsTypes.h"
+
+// Replays player key presses from a string, one symbol per press:
+//   'L', 'R', 'U', 'D' - move, '.' - pass, 'E' - explore
+// Every press is followed by a release frame so edge-triggered moves register.
+// Script loops once exhausted.
+class ScriptedInput
+{
+  std::string script;
+  size_t frame = 0;
+public:
+  ScriptedInput(std::string in_script) : script(std::move(in_script)) {}
+
+  PlayerInput next()
+  {
+    PlayerInput keys;
+    if (script.empty())
+      return keys;
+    const size_t idx = frame++;
+    if (idx % 2 == 1)
+      return keys; // release
+    switch (script[(idx / 2) % script.size()])
+    {
+      case 'L': keys.left = true; break;
+      case 'R': keys.right = true; break;
+      case 'U': keys.up = true; break;
+      case 'D': keys.down = true; break;
+      case '.': keys.passed = true; break;
+      case 'E': keys.explore = true; break;
+      default: break;
+    }
+    return keys;
+  }
+};
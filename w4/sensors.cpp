@@ -0,0 +1,167 @@
+#include "sensors.h"
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <vector>
+#include "aiUtils.h"
+#include "math.h"
+#include "workerPool.h"
+
+struct SensorGridEntry
+{
+  flecs::entity entity;
+  Position pos;
+  int team = 0;
+};
+
+// Entries bucketed by cell with a counting sort over the bounding box of the turn.
+// Rebuilt every turn, vectors are kept so later turns don't allocate.
+class SensorGrid
+{
+public:
+  static constexpr int cell_size = 8;
+
+  void build(const std::vector<SensorGridEntry> &in)
+  {
+    minX = minY = 0;
+    width = height = 1;
+    if (!in.empty())
+    {
+      int maxX = in.front().pos.x, maxY = in.front().pos.y;
+      minX = maxX;
+      minY = maxY;
+      for (const SensorGridEntry &e : in)
+      {
+        minX = std::min(minX, e.pos.x);
+        minY = std::min(minY, e.pos.y);
+        maxX = std::max(maxX, e.pos.x);
+        maxY = std::max(maxY, e.pos.y);
+      }
+      width = (maxX - minX) / cell_size + 1;
+      height = (maxY - minY) / cell_size + 1;
+    }
+    cellStart.assign(size_t(width * height) + 1, 0);
+    for (const SensorGridEntry &e : in)
+      ++cellStart[cell(e.pos) + 1];
+    for (size_t i = 1; i < cellStart.size(); ++i)
+      cellStart[i] += cellStart[i - 1];
+    cursor.assign(cellStart.begin(), cellStart.end() - 1);
+    entries.resize(in.size());
+    for (const SensorGridEntry &e : in)
+      entries[cursor[cell(e.pos)]++] = e;
+  }
+
+  // Closest entry passing pred, cells are visited in rings around pos until no closer entry can be left.
+  template<typename Pred>
+  const SensorGridEntry *nearest(const Position &pos, Pred pred, float &best_dist_sq) const
+  {
+    const SensorGridEntry *best = nullptr;
+    best_dist_sq = FLT_MAX;
+    const int cx = cell_x(pos.x);
+    const int cy = cell_y(pos.y);
+    const int maxRing = std::max({cx, width - 1 - cx, cy, height - 1 - cy});
+    for (int r = 0; r <= maxRing; ++r)
+    {
+      for (int y = std::max(cy - r, 0); y <= std::min(cy + r, height - 1); ++y)
+      {
+        const int step = (y == cy - r || y == cy + r) ? 1 : 2 * r; // inner rows only have the ring ends
+        for (int x = cx - r; x <= cx + r; x += step)
+        {
+          if (x < 0 || x >= width)
+            continue;
+          const size_t c = size_t(y * width + x);
+          for (uint32_t i = cellStart[c]; i < cellStart[c + 1]; ++i)
+          {
+            const SensorGridEntry &e = entries[i];
+            const float distSq = dist_sq(pos, e.pos);
+            if (distSq < best_dist_sq && pred(e))
+            {
+              best_dist_sq = distSq;
+              best = &e;
+            }
+          }
+        }
+      }
+      // cells of the next ring are further than r cells away
+      if (best && best_dist_sq <= sqr(float(r * cell_size)))
+        break;
+    }
+    return best;
+  }
+
+  // every entry in the cells overlapping the square around pos
+  template<typename Callable>
+  void each_around(const Position &pos, float radius, Callable c) const
+  {
+    const int r = int(std::ceil(radius));
+    for (int y = cell_y(pos.y - r); y <= cell_y(pos.y + r); ++y)
+      for (int x = cell_x(pos.x - r); x <= cell_x(pos.x + r); ++x)
+      {
+        const size_t cl = size_t(y * width + x);
+        for (uint32_t i = cellStart[cl]; i < cellStart[cl + 1]; ++i)
+          c(entries[i]);
+      }
+  }
+
+private:
+  int cell_x(int x) const { return std::clamp((x - minX) / cell_size, 0, width - 1); }
+  int cell_y(int y) const { return std::clamp((y - minY) / cell_size, 0, height - 1); }
+  size_t cell(const Position &pos) const { return size_t(cell_y(pos.y) * width + cell_x(pos.x)); }
+
+  int minX = 0;
+  int minY = 0;
+  int width = 1;
+  int height = 1;
+  std::vector<uint32_t> cellStart; // entries of cell c are [cellStart[c], cellStart[c + 1])
+  std::vector<uint32_t> cursor;
+  std::vector<SensorGridEntry> entries;
+};
+
+void update_sensors(flecs::world &ecs)
+{
+  static auto sensorsQuery = ecs.query<Sensors, const Position, const Team>();
+  static SensorGrid grid;
+  static std::vector<SensorGridEntry> entries;
+  static std::vector<std::tuple<flecs::entity, Sensors*, Position, int>> agents;
+
+  entries.clear();
+  team_positions_query(ecs).each([&](flecs::entity e, const Position &pos, const Team &team)
+  {
+    entries.push_back(SensorGridEntry{e, pos, team.team});
+  });
+  grid.build(entries);
+
+  agents.clear();
+  sensorsQuery.each([&](flecs::entity e, Sensors &s, const Position &pos, const Team &team)
+  {
+    agents.emplace_back(e, &s, pos, team.team);
+  });
+  // only the grid is read from here on and every agent writes its own sensors
+  jobs::parallel_for(agents.size(), [&](size_t, size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const auto &[e, s, pos, team] = agents[i];
+      float distSq = FLT_MAX;
+      const SensorGridEntry *enemy = grid.nearest(pos, [&](const SensorGridEntry &o) { return o.team != team; }, distSq);
+      s->closestEnemy = enemy ? enemy->entity : flecs::entity();
+      s->closestEnemyPos = enemy ? enemy->pos : Position{};
+      s->closestEnemyDist = enemy ? sqrtf(distSq) : FLT_MAX;
+
+      const SensorGridEntry *ally = grid.nearest(pos, [&](const SensorGridEntry &o)
+      {
+        return o.team == team && o.entity != e;
+      }, distSq);
+      s->closestAlly = ally ? ally->entity : flecs::entity();
+      s->closestAllyDist = ally ? sqrtf(distSq) : FLT_MAX;
+
+      float alliesNearby = 0.f;
+      grid.each_around(pos, Sensors::allies_radius, [&](const SensorGridEntry &o)
+      {
+        if (o.team == team && dist_sq(pos, o.pos) < sqr(Sensors::allies_radius))
+          alliesNearby += 1.f;
+      });
+      s->alliesNearby = alliesNearby;
+    }
+  });
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <float.h>
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// Filled once per turn by update_sensors, every AI library reads its entity's surroundings from here.
+struct Sensors
+{
+  static constexpr float allies_radius = 5.f;
+
+  flecs::entity closestEnemy; // invalid without enemies
+  Position closestEnemyPos;
+  float closestEnemyDist = FLT_MAX;
+  flecs::entity closestAlly; // the entity itself doesn't count
+  float closestAllyDist = FLT_MAX;
+  float alliesNearby = 0.f; // closer than allies_radius, the entity itself included
+};
+
+// Buckets every Position + Team entity into a grid and answers the nearest queries from there,
+// call before decisions.
+void update_sensors(flecs::world &ecs);
@@ -1,4 +1,5 @@
 #include "stateMachine.h"
+#include "flatStateMachine.h"
 
 StateMachine::~StateMachine()
 {
@@ -11,34 +12,70 @@ StateMachine::~StateMachine()
   transitions.clear();
 }
 
-void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
+void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity, uint32_t events)
 {
   if (curStateIdx < states.size())
   {
-    for (const std::pair<StateTransition*, int> &transition : transitions[curStateIdx])
-      if (transition.first->isAvailable(ecs, entity))
-      {
-        states[curStateIdx]->exit();
-        curStateIdx = size_t(transition.second);
-        states[curStateIdx]->enter();
-        break;
-      }
+    if (entered || (stateEvents[curStateIdx] & events))
+    {
+      entered = false;
+      for (const std::pair<StateTransition*, int> &transition : transitions[curStateIdx])
+        if (transition.first->isAvailable(ecs, entity))
+        {
+          states[curStateIdx]->exit();
+          curStateIdx = size_t(transition.second);
+          states[curStateIdx]->enter();
+          entered = true;
+          break;
+        }
+    }
     states[curStateIdx]->act(dt, ecs, entity);
   }
   else
     curStateIdx = 0;
 }
 
+bool StateMachine::isIdle(uint32_t events) const
+{
+  if (curStateIdx >= states.size())
+    return states.empty();
+  return !entered && !(stateEvents[curStateIdx] & events) && states[curStateIdx]->idle();
+}
+
+void StateMachine::subscribe(Perception &perception)
+{
+  for (size_t i = 0; i < states.size(); ++i)
+  {
+    stateEvents[i] = 0;
+    for (const std::pair<StateTransition*, int> &transition : transitions[i])
+      stateEvents[i] |= transition.first->subscribe(perception);
+  }
+}
+
 int StateMachine::addState(State *st)
 {
   size_t idx = states.size();
   states.push_back(st);
   transitions.push_back(std::vector<std::pair<StateTransition*, int>>());
+  stateEvents.push_back(PE_ALL);
   return int(idx);
 }
 
 void StateMachine::addTransition(StateTransition *trans, int from, int to)
 {
   transitions[size_t(from)].push_back(std::make_pair(trans, to));
+  stateEvents[size_t(from)] = PE_ALL; // until the next subscribe
 }
 
+
+void StateMachine::compile(FlatFsmBuilder &builder) const
+{
+  for (const State *state : states)
+    state->compile(builder);
+  for (size_t from = 0; from < transitions.size(); ++from)
+    for (const std::pair<StateTransition*, int> &transition : transitions[from])
+    {
+      transition.first->compile(builder);
+      builder.add_transition(uint32_t(from), uint32_t(transition.second));
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <flecs.h>
+#include "perception.h"
+
+class FlatFsmBuilder;
 
 class State
 {
@@ -9,6 +12,10 @@ public:
   virtual void enter() const = 0;
   virtual void exit() const = 0;
   virtual void act(float dt, flecs::world &ecs, flecs::entity entity) const = 0;
+  // act does nothing, the machine can be skipped while its transitions have nothing to re-check
+  virtual bool idle() const { return false; }
+  // adds the state with the action act runs, see FsmAct
+  virtual uint32_t compile(FlatFsmBuilder &builder) const = 0;
 };
 
 class StateTransition
@@ -16,6 +23,11 @@ class StateTransition
 public:
   virtual ~StateTransition() {}
   virtual bool isAvailable(flecs::world &ecs, flecs::entity entity) const = 0;
+  // watches what the result depends on and returns the events that can change it,
+  // PE_ALL keeps the transition polled on every act
+  virtual uint32_t subscribe(Perception &) const { return PE_ALL; }
+  // emits the condition as code that leaves one bool on the stack, see FsmOp
+  virtual void compile(FlatFsmBuilder &builder) const = 0;
 };
 
 class StateMachine
@@ -23,18 +35,27 @@ class StateMachine
   size_t curStateIdx = 0;
   std::vector<State*> states;
   std::vector<std::vector<std::pair<StateTransition*, int>>> transitions;
+  std::vector<uint32_t> stateEvents; // per state, events its transitions subscribed to
+  bool entered = true; // transitions of a state are checked once when it is entered
 public:
   StateMachine() = default;
-  StateMachine(const StateMachine &sm) = default;
+  StateMachine(const StateMachine &sm) = delete; // owns its states and transitions
   StateMachine(StateMachine &&sm) = default;
 
   ~StateMachine();
 
-  StateMachine &operator=(const StateMachine &sm) = default;
+  StateMachine &operator=(const StateMachine &sm) = delete;
   StateMachine &operator=(StateMachine &&sm) = default;
 
 
-  void act(float dt, flecs::world &ecs, flecs::entity entity);
+  // transitions of the current state are only checked when one of their events is in events
+  void act(float dt, flecs::world &ecs, flecs::entity entity, uint32_t events = PE_ALL);
+  // act would neither change the state nor do anything
+  bool isIdle(uint32_t events) const;
+  // call once the machine is built, machines that never subscribed poll all transitions
+  void subscribe(Perception &perception);
+  // states keep their indices
+  void compile(FlatFsmBuilder &builder) const;
 
   int addState(State *st);
   void addTransition(StateTransition *trans, int from, int to);
@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <flecs.h>
+#include "behaviourTree.h"
+#include "behLeaves.h"
+#include "blackboard.h"
+
+// Behaviour trees declared as types, e.g.
+//   Selector<Sequence<IsLowHp<50>, FindEnemy<4>, Flee<>>, Patrol<2>>
+// The whole tree is one set of static functions the compiler can inline, nothing is allocated
+// and nothing is dispatched at runtime. Leaves run the same logic as behLibrary.
+namespace sbt
+{
+  // blackboard name usable as a template argument
+  template<size_t N>
+  struct BbName
+  {
+    char str[N];
+    constexpr BbName(const char (&s)[N]) { std::copy_n(s, N, str); }
+  };
+
+  template<typename DataType, BbName Name>
+  inline size_t key()
+  {
+    static const size_t k = bb_key<DataType>(Name.str);
+    return k;
+  }
+
+  template<typename... Nodes>
+  struct Sequence
+  {
+    static void init(flecs::entity entity, Blackboard &bb) { (Nodes::init(entity, bb), ...); }
+    static BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+    {
+      BehResult res = BEH_SUCCESS;
+      (void)(((res = Nodes::tick(ecs, entity, bb)) == BEH_SUCCESS) && ...);
+      return res;
+    }
+  };
+
+  // leading children of a MemorySequence
+  template<typename... Nodes>
+  struct Guards : Sequence<Nodes...> {};
+
+  template<>
+  struct Guards<>
+  {
+    static void init(flecs::entity, Blackboard &) {}
+    static BehResult tick(flecs::world &, flecs::entity, Blackboard &) { return BEH_SUCCESS; }
+  };
+
+  // MemorySequence<Guards<...>, Nodes...>, like the virtual node it keeps no per-tick state and
+  // re-walks guards and nodes on every tick, only flat trees resume at the running node
+  template<typename GuardList, typename... Nodes>
+  struct MemorySequence : Sequence<GuardList, Nodes...> {};
+
+  template<typename... Nodes>
+  struct Selector
+  {
+    static void init(flecs::entity entity, Blackboard &bb) { (Nodes::init(entity, bb), ...); }
+    static BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+    {
+      BehResult res = BEH_FAIL;
+      (void)(((res = Nodes::tick(ecs, entity, bb)) == BEH_FAIL) && ...);
+      return res;
+    }
+  };
+
+  // child of UtilitySelector, Score is float(Blackboard&)
+  template<auto Score, typename Node>
+  struct Utility
+  {
+    static float score(Blackboard &bb) { return Score(bb); }
+    static void init(flecs::entity entity, Blackboard &bb) { Node::init(entity, bb); }
+    static BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+    {
+      return Node::tick(ecs, entity, bb);
+    }
+  };
+
+  template<typename... Options>
+  struct UtilitySelector
+  {
+    static_assert(sizeof...(Options) <= max_utility_options);
+    static void init(flecs::entity entity, Blackboard &bb) { (Options::init(entity, bb), ...); }
+    static BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+    {
+      return tick_by_utility(ecs, entity, bb, std::index_sequence_for<Options...>{});
+    }
+
+  private:
+    template<size_t... Is>
+    static BehResult tick_by_utility(flecs::world &ecs, flecs::entity entity, Blackboard &bb,
+                                     std::index_sequence<Is...>)
+    {
+      const float scores[] = {Options::score(bb)...};
+      return run_by_utility(scores, sizeof...(Options), [&](size_t option)
+      {
+        BehResult res = BEH_FAIL;
+        ((option == Is ? (res = Options::tick(ecs, entity, bb), true) : false) || ...);
+        return res;
+      });
+    }
+  };
+
+  template<BbName Name = "enemy">
+  struct MoveToEntity
+  {
+    static void init(flecs::entity, Blackboard &bb) { bb.regKey<flecs::entity>(key<flecs::entity, Name>()); }
+    static BehResult tick(flecs::world &, flecs::entity entity, Blackboard &bb)
+    {
+      return beh::move_to_entity(entity, bb, key<flecs::entity, Name>());
+    }
+  };
+
+  template<float Thres>
+  struct IsLowHp
+  {
+    static void init(flecs::entity, Blackboard &) {}
+    static BehResult tick(flecs::world &, flecs::entity entity, Blackboard &)
+    {
+      return beh::is_low_hp(entity, Thres);
+    }
+  };
+
+  template<float Dist, BbName Name = "enemy">
+  struct FindEnemy
+  {
+    static void init(flecs::entity, Blackboard &bb) { bb.regKey<flecs::entity>(key<flecs::entity, Name>()); }
+    static BehResult tick(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+    {
+      return beh::find_enemy(ecs, entity, bb, Dist, key<flecs::entity, Name>());
+    }
+  };
+
+  template<BbName Name = "enemy">
+  struct Flee
+  {
+    static void init(flecs::entity, Blackboard &bb) { bb.regKey<flecs::entity>(key<flecs::entity, Name>()); }
+    static BehResult tick(flecs::world &, flecs::entity entity, Blackboard &bb)
+    {
+      return beh::flee(entity, bb, key<flecs::entity, Name>());
+    }
+  };
+
+  template<float Dist, BbName Name = "patrol_pos">
+  struct Patrol
+  {
+    static void init(flecs::entity entity, Blackboard &bb) { beh::init_patrol(entity, bb, key<Position, Name>()); }
+    static BehResult tick(flecs::world &, flecs::entity entity, Blackboard &bb)
+    {
+      return beh::patrol(entity, bb, Dist, key<Position, Name>());
+    }
+  };
+
+  template<float Thres>
+  struct PatchUp
+  {
+    static void init(flecs::entity, Blackboard &) {}
+    static BehResult tick(flecs::world &, flecs::entity entity, Blackboard &)
+    {
+      return beh::patch_up(entity, Thres);
+    }
+  };
+}
@@ -1,7 +1,7 @@
 #include "aiLibrary.h"
 #include <flecs.h>
 #include "ecsTypes.h"
-#include "raylib.h"
+#include "rng.h"
 #include "math.h"
 #include "aiUtils.h"
 
@@ -58,7 +58,7 @@ public:
       else
       {
         // do a random walk
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1);
+        a.action = rng::range(EA_MOVE_START, EA_MOVE_END - 1);
       }
     });
   }
@@ -79,11 +79,11 @@ public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    auto enemiesQuery = ecs.query<const Position, const Team>();
+    auto &enemiesQuery = team_positions_query(ecs);
     bool enemiesFound = false;
     entity.get([&](const Position &pos, const Team &t)
     {
-      enemiesQuery.each([&](const Position &epos, const Team &et)
+      enemiesQuery.iter(ecs).each([&](const Position &epos, const Team &et)
       {
         if (t.team == et.team)
           return;
@@ -22,16 +22,24 @@ inline int inverse_move(int move)
          move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
 }
 
+// Shared by all AI nodes. Has to be created on the main thread before decisions fan out
+// to worker stages, iterate it with .iter(ecs) so a stage world is used when one is passed in.
+inline flecs::query<const Position, const Team> &team_positions_query(flecs::world &ecs)
+{
+  static auto teamPositionsQuery = ecs.query<const Position, const Team>();
+  return teamPositionsQuery;
+}
+
 template<typename Callable>
 inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
 {
-  auto enemiesQuery = ecs.query<const Position, const Team>();
+  auto &enemiesQuery = team_positions_query(ecs);
   entity.insert([&](const Position &pos, const Team &t, Action &a)
   {
     flecs::entity closestEnemy;
     float closestDist = FLT_MAX;
     Position closestPos;
-    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+    enemiesQuery.iter(ecs).each([&](flecs::entity enemy, const Position &epos, const Team &et)
     {
       if (t.team == et.team)
         return;
@@ -2,7 +2,7 @@
 #include "ecsTypes.h"
 #include "aiUtils.h"
 #include "math.h"
-#include "raylib.h"
+#include "rng.h"
 #include "blackboard.h"
 #include <algorithm>
 
@@ -140,13 +140,13 @@ struct FindEnemy : public BehNode
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
     BehResult res = BEH_FAIL;
-    auto enemiesQuery = ecs.query<const Position, const Team>();
-    entity.insert([&](const Position &pos, const Team &t)
+    auto &enemiesQuery = team_positions_query(ecs);
+    entity.get([&](const Position &pos, const Team &t)
     {
       flecs::entity closestEnemy;
       float closestDist = FLT_MAX;
       Position closestPos;
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+      enemiesQuery.iter(ecs).each([&](flecs::entity enemy, const Position &epos, const Team &et)
       {
         if (t.team == et.team)
           return;
@@ -219,7 +219,7 @@ struct Patrol : public BehNode
       if (dist(pos, patrolPos) > patrolDist)
         a.action = move_towards(pos, patrolPos);
       else
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
+        a.action = rng::range(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
     });
     return res;
   }
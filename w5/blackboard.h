@@ -1,71 +1,136 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 #include <flecs.h>
 #include "ecsTypes.h"
 
+// Names are interned once per value type into global keys, the string is only hashed here.
+// Keep the key (static or captured) and pass it around instead of the name.
 template<typename DataType>
-class NamedDataPool
+size_t bb_key(const std::string &name)
+{
+  static std::mutex lock;
+  static std::unordered_map<std::string, size_t> keys;
+  std::lock_guard<std::mutex> guard(lock);
+  return keys.emplace(name, keys.size()).first->second;
+}
+
+// Key -> slot layout shared by all blackboards of one archetype, so entities only keep values.
+// Adding keys is main thread only (entity setup and sensors), lookups are plain index reads.
+class BlackboardSchema
 {
 public:
-  size_t regName(const std::string &name)
+  static constexpr size_t npos = size_t(-1);
+
+  template<typename DataType>
+  size_t slot(size_t key) const
   {
-    const auto itf = nameIndices.find(name);
-    if (itf != nameIndices.end())
-      return itf->second;
-
-    size_t idx = data.size();
-    nameIndices.emplace(name, idx);
-    data.emplace_back(DataType());
-    return idx;
+    const Table &t = table<DataType>();
+    return key < t.slots.size() ? t.slots[key] : npos;
   }
 
-  void set(size_t idx, const DataType &in_data)
+  template<typename DataType>
+  size_t add(size_t key)
   {
-    data[idx] = in_data;
+    Table &t = table<DataType>();
+    if (key >= t.slots.size())
+      t.slots.resize(key + 1, npos);
+    if (t.slots[key] == npos)
+      t.slots[key] = t.count++;
+    return t.slots[key];
   }
 
-  DataType get(size_t idx) const
+  template<typename DataType>
+  size_t size() const { return table<DataType>().count; }
+
+private:
+  struct Table
+  {
+    std::vector<size_t> slots; // indexed by key
+    size_t count = 0;
+  };
+
+  template<typename DataType>
+  static constexpr size_t type_idx()
   {
-    return data[idx];
+    if constexpr (std::is_same_v<DataType, float>)
+      return 0;
+    else if constexpr (std::is_same_v<DataType, int>)
+      return 1;
+    else if constexpr (std::is_same_v<DataType, flecs::entity>)
+      return 2;
+    else
+    {
+      static_assert(std::is_same_v<DataType, Position>, "unsupported blackboard type");
+      return 3;
+    }
   }
-private:
-  std::unordered_map<std::string, size_t> nameIndices;
-  std::vector<DataType> data;
+
+  template<typename DataType>
+  Table &table() { return tables[type_idx<DataType>()]; }
+  template<typename DataType>
+  const Table &table() const { return tables[type_idx<DataType>()]; }
+
+  Table tables[4];
 };
 
-class Blackboard : public NamedDataPool<float>,
-                   public NamedDataPool<int>,
-                   public NamedDataPool<flecs::entity>,
-                   public NamedDataPool<Position>
+class Blackboard
 {
 public:
+  Blackboard() = default;
+  // blackboards of one archetype should share the schema
+  explicit Blackboard(std::shared_ptr<BlackboardSchema> in_schema) : schema(std::move(in_schema)) {}
+
   template<typename DataType>
   size_t regName(const std::string &name)
   {
-    return NamedDataPool<DataType>::regName(name);
+    return regKey<DataType>(bb_key<DataType>(name));
+  }
+
+  template<typename DataType>
+  size_t regKey(size_t key)
+  {
+    if (!schema)
+      schema = std::make_shared<BlackboardSchema>();
+    schema->add<DataType>(key);
+    return key;
   }
 
+  // keys have to be registered first (regKey/regName), writes to unknown keys are dropped like get returns a default
   template<typename DataType>
-  void set(size_t idx, const DataType &in_data)
+  void set(size_t key, const DataType &in_data)
   {
-    NamedDataPool<DataType>::set(idx, in_data);
+    const size_t slot = schema ? schema->slot<DataType>(key) : BlackboardSchema::npos;
+    if (slot == BlackboardSchema::npos)
+      return;
+    std::vector<DataType> &data = std::get<std::vector<DataType>>(values);
+    if (slot >= data.size())
+      data.resize(schema->size<DataType>());
+    data[slot] = in_data;
   }
 
   template<typename DataType>
-  DataType get(size_t idx) const
+  DataType get(size_t key) const
   {
-    return NamedDataPool<DataType>::get(idx);
+    const size_t slot = schema ? schema->slot<DataType>(key) : BlackboardSchema::npos;
+    const std::vector<DataType> &data = std::get<std::vector<DataType>>(values);
+    return slot < data.size() ? data[slot] : DataType();
   }
 
   // not perf optimized
   template<typename DataType>
   DataType get(const char *name)
   {
-    size_t idx = regName<DataType>(name);
-    return NamedDataPool<DataType>::get(idx);
+    return get<DataType>(regName<DataType>(name));
   }
-};
 
+private:
+  std::shared_ptr<BlackboardSchema> schema;
+  std::tuple<std::vector<float>, std::vector<int>, std::vector<flecs::entity>, std::vector<Position>> values;
+};
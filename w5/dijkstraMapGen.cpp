@@ -1,6 +1,12 @@
 #include "dijkstraMapGen.h"
 #include "ecsTypes.h"
 #include "dungeonUtils.h"
+#include "dmapSweep.h"
+#include "workerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
 
 template<typename Callable>
 static void query_dungeon_data(flecs::world &ecs, Callable c)
@@ -18,91 +24,425 @@ static void query_characters_positions(flecs::world &ecs, Callable c)
   characterPositionQuery.each(c);
 }
 
-constexpr float invalid_tile_value = 1e5f;
+constexpr float invalid_tile_value = DijkstraMapData::invalid_value;
+constexpr float forbidden_tile_value = DijkstraMapData::forbidden_value;
 
-static void init_tiles(std::vector<float> &map, const DungeonData &dd)
+static void init_tiles(std::vector<float> &map, const dmaps::WalkMask &grid)
 {
-  map.resize(dd.width * dd.height);
+  map.resize(grid.width * grid.height);
   for (float &v : map)
     v = invalid_tile_value;
 }
 
-// scan version, could be implemented as Dijkstra version as well
-static void process_dmap(std::vector<float> &map, const DungeonData &dd)
+// Dial's algorithm: edges cost 1, so bucket width 1 is exact - a tile can't be improved
+// from inside its own bucket. Every tile ends up with the smallest of its current value and
+// (neighbour + 1), propagation starts from seeds and only touches tiles it improves.
+static void propagate_dmap(std::vector<float> &map, const dmaps::WalkMask &grid, const std::vector<uint32_t> &seeds)
 {
-  bool done = false;
-  auto getMapAt = [&](size_t x, size_t y, float def)
+  const size_t w = grid.width;
+  const size_t h = grid.height;
+
+  float base = invalid_tile_value;
+  for (uint32_t idx : seeds)
+    base = std::min(base, map[idx]);
+  if (base >= invalid_tile_value)
+    return; // nothing to propagate
+
+  auto bucket_of = [&](float v) { return size_t(v - base); };
+  std::vector<std::vector<uint32_t>> buckets;
+  auto push = [&](size_t idx)
   {
-    if (x < dd.width && y < dd.width && dd.tiles[y * dd.width + x] == dungeon::floor)
-      return map[y * dd.width + x];
-    return def;
+    const size_t b = bucket_of(map[idx]);
+    if (b >= buckets.size())
+      buckets.resize(b + 1);
+    buckets[b].push_back(uint32_t(idx));
   };
-  auto getMinNei = [&](size_t x, size_t y)
-  {
-    float val = map[y * dd.width + x];
-    val = std::min(val, getMapAt(x - 1, y + 0, val));
-    val = std::min(val, getMapAt(x + 1, y + 0, val));
-    val = std::min(val, getMapAt(x + 0, y - 1, val));
-    val = std::min(val, getMapAt(x + 0, y + 1, val));
-    return val;
+  for (uint32_t idx : seeds)
+    push(idx);
+
+  auto relax = [&](size_t idx, float val)
+  {
+    if (grid.walkable[idx] && val < map[idx])
+    {
+      map[idx] = val;
+      push(idx);
+    }
   };
-  while (!done)
+  for (size_t b = 0; b < buckets.size(); ++b)
   {
-    done = true;
-    for (size_t y = 0; y < dd.height; ++y)
-      for (size_t x = 0; x < dd.width; ++x)
-      {
-        const size_t i = y * dd.width + x;
-        if (dd.tiles[i] != dungeon::floor)
-          continue;
-        const float myVal = getMapAt(x, y, invalid_tile_value);
-        const float minVal = getMinNei(x, y);
-        if (minVal < myVal - 1.f)
-        {
-          map[i] = minVal + 1.f;
-          done = false;
-        }
-      }
+    // can't hold a reference, relaxing may grow the bucket list
+    for (size_t k = 0; k < buckets[b].size(); ++k)
+    {
+      const size_t idx = buckets[b][k];
+      if (bucket_of(map[idx]) != b)
+        continue; // stale entry, tile got a better value later
+      const size_t x = idx % w;
+      const size_t y = idx / w;
+      const float next = map[idx] + 1.f;
+      if (x > 0)
+        relax(idx - 1, next);
+      if (x + 1 < w)
+        relax(idx + 1, next);
+      if (y > 0)
+        relax(idx - w, next);
+      if (y + 1 < h)
+        relax(idx + w, next);
+    }
+    buckets[b].clear();
+    buckets[b].shrink_to_fit();
   }
 }
 
-void dmaps::gen_player_approach_map(flecs::world &ecs, std::vector<float> &map)
+// only values below invalid_tile_value act as sources, so sentinels never spread
+// into regions that have no source at all
+static void process_dmap(std::vector<float> &map, const dmaps::WalkMask &grid,
+                        dmaps::Backend backend = dmaps::Backend::BucketQueue)
 {
-  query_dungeon_data(ecs, [&](const DungeonData &dd)
+  if (backend == dmaps::Backend::Sweep)
+  {
+    dmaps::sweep_dmap(map, grid, invalid_tile_value);
+    return;
+  }
+  std::vector<uint32_t> seeds;
+  for (size_t i = 0; i < map.size(); ++i)
+    if (grid.walkable[i] && map[i] < invalid_tile_value)
+      seeds.push_back(uint32_t(i));
+  propagate_dmap(map, grid, seeds);
+}
+
+// Repairs a map of zero-valued sources after they were added, removed or moved, in the spirit of LPA*.
+// Raise: tiles that lost every neighbour one step closer to a source are reset, walking out from the
+// removed sources in distance order. Lower: reset tiles and new sources are propagated again.
+// Both phases only visit the region whose distances actually change.
+static void repair_dmap(std::vector<float> &map, DmapSources &state, std::vector<uint32_t> &sources,
+                        const dmaps::WalkMask &grid, dmaps::Backend backend)
+{
+  thread_local std::vector<uint8_t> isRaised; // per tile, all zero between repairs
+  if (isRaised.size() < map.size())
+    isRaised.resize(map.size(), 0);
+  std::sort(sources.begin(), sources.end());
+  sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+  if (map.size() != grid.width * grid.height)
+  {
+    init_tiles(map, grid);
+    for (uint32_t idx : sources)
+      map[idx] = 0.f;
+    process_dmap(map, grid, backend);
+    state.tiles.swap(sources);
+    return;
+  }
+
+  std::vector<uint32_t> removed;
+  std::vector<uint32_t> added;
+  std::set_difference(state.tiles.begin(), state.tiles.end(), sources.begin(), sources.end(),
+                      std::back_inserter(removed));
+  std::set_difference(sources.begin(), sources.end(), state.tiles.begin(), state.tiles.end(),
+                      std::back_inserter(added));
+  state.tiles.swap(sources);
+  if (removed.empty() && added.empty())
+    return;
+
+  const size_t w = grid.width;
+  const size_t h = grid.height;
+  auto for_each_nei = [&](size_t idx, auto c)
+  {
+    const size_t x = idx % w;
+    const size_t y = idx / w;
+    if (x > 0 && grid.walkable[idx - 1])
+      c(idx - 1);
+    if (x + 1 < w && grid.walkable[idx + 1])
+      c(idx + 1);
+    if (y > 0 && grid.walkable[idx - w])
+      c(idx - w);
+    if (y + 1 < h && grid.walkable[idx + w])
+      c(idx + w);
+  };
+
+  // raise, fifo order is distance order as all sources sit at 0
+  std::vector<uint32_t> raised;
+  for (uint32_t idx : removed)
+  {
+    isRaised[idx] = 1;
+    raised.push_back(idx);
+  }
+  for (size_t k = 0; k < raised.size(); ++k)
   {
-    init_tiles(map, dd);
-    query_characters_positions(ecs, [&](const Position &pos, const Team &t)
+    const size_t cur = raised[k];
+    const float childVal = map[cur] + 1.f;
+    for_each_nei(cur, [&](size_t nei)
     {
-      if (t.team == 0) // player team hardcode
-        map[pos.y * dd.width + pos.x] = 0.f;
+      if (isRaised[nei] || map[nei] != childVal)
+        return;
+      bool supported = false;
+      for_each_nei(nei, [&](size_t support)
+      {
+        supported |= !isRaised[support] && map[support] == childVal - 1.f;
+      });
+      if (!supported)
+      {
+        isRaised[nei] = 1;
+        raised.push_back(uint32_t(nei));
+      }
     });
-    process_dmap(map, dd);
+  }
+
+  // lower, reset tiles take the best value from their surviving neighbours
+  for (uint32_t idx : raised)
+    map[idx] = invalid_tile_value;
+  std::vector<uint32_t> seeds;
+  for (uint32_t idx : raised)
+  {
+    isRaised[idx] = 0;
+    for_each_nei(idx, [&](size_t nei)
+    {
+      if (map[nei] + 1.f < map[idx])
+        map[idx] = map[nei] + 1.f;
+    });
+    if (map[idx] < invalid_tile_value)
+      seeds.push_back(idx);
+  }
+  for (uint32_t idx : added)
+  {
+    map[idx] = 0.f;
+    seeds.push_back(idx);
+  }
+  propagate_dmap(map, grid, seeds);
+}
+
+dmaps::WalkMask dmaps::make_walk_mask(const DungeonData &dd)
+{
+  WalkMask grid;
+  grid.width = dd.width;
+  grid.height = dd.height;
+  grid.walkable.resize(dd.tiles.size());
+  for (size_t i = 0; i < dd.tiles.size(); ++i)
+    grid.walkable[i] = dd.tiles[i] == dungeon::floor ? 1 : 0;
+  return grid;
+}
+
+static std::vector<uint32_t> player_tiles(flecs::world &ecs, const dmaps::WalkMask &grid)
+{
+  std::vector<uint32_t> tiles;
+  query_characters_positions(ecs, [&](const Position &pos, const Team &t)
+  {
+    if (t.team == 0) // player team hardcode
+      tiles.push_back(uint32_t(pos.y * grid.width + pos.x));
   });
+  return tiles;
 }
 
-void dmaps::gen_player_flee_map(flecs::world &ecs, std::vector<float> &map)
+static std::vector<uint32_t> hive_tiles(flecs::world &ecs, const dmaps::WalkMask &grid)
+{
+  auto hiveQuery = ecs.query<const Position, const Hive>();
+  std::vector<uint32_t> tiles;
+  hiveQuery.each([&](const Position &pos, const Hive &)
+  {
+    tiles.push_back(uint32_t(pos.y * grid.width + pos.x));
+  });
+  return tiles;
+}
+
+static void build_source_map(std::vector<float> &map, const std::vector<uint32_t> &tiles, const dmaps::WalkMask &grid,
+                             dmaps::Backend backend = dmaps::Backend::BucketQueue)
+{
+  init_tiles(map, grid);
+  for (uint32_t idx : tiles)
+    map[idx] = 0.f;
+  process_dmap(map, grid, backend);
+}
+
+// map holds the player approach map
+static void build_flee_map(std::vector<float> &map, const dmaps::WalkMask &grid,
+                           dmaps::Backend backend = dmaps::Backend::BucketQueue)
 {
-  gen_player_approach_map(ecs, map);
   for (float &v : map)
     if (v < invalid_tile_value)
       v *= -1.2f;
+  process_dmap(map, grid, backend);
+}
+
+void dmaps::gen_player_approach_map(flecs::world &ecs, std::vector<float> &map, Backend backend)
+{
   query_dungeon_data(ecs, [&](const DungeonData &dd)
   {
-    process_dmap(map, dd);
+    const WalkMask grid = make_walk_mask(dd);
+    build_source_map(map, player_tiles(ecs, grid), grid, backend);
   });
 }
 
-void dmaps::gen_hive_pack_map(flecs::world &ecs, std::vector<float> &map)
+void dmaps::gen_player_flee_map(flecs::world &ecs, std::vector<float> &map)
 {
-  auto hiveQuery = ecs.query<const Position, const Hive>();
   query_dungeon_data(ecs, [&](const DungeonData &dd)
   {
-    init_tiles(map, dd);
-    hiveQuery.each([&](const Position &pos, const Hive &)
-    {
-      map[pos.y * dd.width + pos.x] = 0.f;
-    });
-    process_dmap(map, dd);
+    const WalkMask grid = make_walk_mask(dd);
+    build_source_map(map, player_tiles(ecs, grid), grid);
+    build_flee_map(map, grid);
+  });
+}
+
+void dmaps::gen_hive_pack_map(flecs::world &ecs, std::vector<float> &map, Backend backend)
+{
+  query_dungeon_data(ecs, [&](const DungeonData &dd)
+  {
+    const WalkMask grid = make_walk_mask(dd);
+    build_source_map(map, hive_tiles(ecs, grid), grid, backend);
   });
 }
 
+bool dmaps::quantize_map(const std::vector<float> &map, DijkstraMapData &dmap)
+{
+  float lo = invalid_tile_value;
+  float hi = -invalid_tile_value;
+  for (float v : map)
+    if (v < invalid_tile_value)
+    {
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+    }
+  // Power of two steps are exact in float. The step stops at one tile so neighbours keep a unit gradient,
+  // anything further than max_code tiles is clamped to the top code.
+  constexpr float max_code = float(DijkstraMapData::invalid_code - 1);
+  dmap.base = lo < invalid_tile_value ? lo : 0.f;
+  dmap.step = 0.125f;
+  while (dmap.step < 1.f && (hi - dmap.base) / dmap.step > max_code)
+    dmap.step *= 2.f;
+
+  dmap.map.resize(map.size());
+  for (size_t i = 0; i < map.size(); ++i)
+  {
+    const float v = map[i];
+    if (v >= forbidden_tile_value)
+      dmap.map[i] = DijkstraMapData::forbidden_code;
+    else if (v >= invalid_tile_value)
+      dmap.map[i] = DijkstraMapData::invalid_code;
+    else
+      dmap.map[i] = uint16_t(std::min(std::nearbyint((v - dmap.base) / dmap.step), max_code));
+  }
+  return lo >= invalid_tile_value || (hi - dmap.base) / dmap.step <= max_code;
+}
+
+// Persistent maps hold zero-valued sources and whole distances, so with a step of at most a tile every code
+// decodes to the exact distance it was built from unless quantize_map had to clamp.
+static void decode_map(const DijkstraMapData &dmap, std::vector<float> &map)
+{
+  map.resize(dmap.map.size());
+  for (size_t i = 0; i < map.size(); ++i)
+    map[i] = dmap.at(i);
+}
+
+// the sweep wins on open caves and loses once walls make paths turn against it, see hwN_dmap_bench
+static dmaps::Backend auto_backend(const dmaps::WalkMask &grid)
+{
+  const size_t floorTiles = size_t(std::count(grid.walkable.begin(), grid.walkable.end(), uint8_t(1)));
+  return floorTiles * 10 >= grid.walkable.size() * 9 ? dmaps::Backend::Sweep : dmaps::Backend::BucketQueue;
+}
+
+static bool is_persistent(dmaps::MapKind kind)
+{
+  return kind == dmaps::MapKind::PlayerApproach || kind == dmaps::MapKind::HivePack;
+}
+
+void dmaps::gen_maps(flecs::world &ecs, const std::vector<MapRequest> &requests)
+{
+  query_dungeon_data(ecs, [&](const DungeonData &dd)
+  {
+    // everything maps are seeded from is gathered here, builders never touch the world
+    const WalkMask grid = make_walk_mask(dd);
+    const std::vector<uint32_t> players = player_tiles(ecs, grid);
+    const std::vector<uint32_t> hives = hive_tiles(ecs, grid);
+
+    struct MapJob
+    {
+      std::vector<float> map;
+      DijkstraMapData quantized;
+      DmapSources sources;
+      size_t approach = size_t(-1); // approach map in this batch
+    };
+    std::vector<MapJob> batch(requests.size());
+    std::vector<size_t> firstWave;
+    std::vector<size_t> fleeWave;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+      const MapRequest &req = requests[i];
+      // persistent maps are moved out of their components and back once repaired
+      if (is_persistent(req.kind))
+        req.target.insert([&](DijkstraMapData &dmap, DmapSources &sources)
+        {
+          std::swap(batch[i].quantized, dmap);
+          std::swap(batch[i].sources, sources);
+        });
+      if (req.kind != MapKind::PlayerFlee)
+      {
+        firstWave.push_back(i);
+        continue;
+      }
+      fleeWave.push_back(i);
+      for (size_t j = 0; j < requests.size(); ++j)
+        if (requests[j].kind == MapKind::PlayerApproach)
+          batch[i].approach = j;
+    }
+
+    const Backend autoBackend = auto_backend(grid);
+    auto build = [&](size_t i)
+    {
+      const Backend backend = requests[i].backend == Backend::Auto ? autoBackend : requests[i].backend;
+      MapJob &job = batch[i];
+      switch (requests[i].kind)
+      {
+        case MapKind::PlayerApproach:
+        {
+          std::vector<uint32_t> tiles = players;
+          repair_dmap(job.map, job.sources, tiles, grid, backend);
+          break;
+        }
+        case MapKind::PlayerFlee:
+          if (job.approach < batch.size())
+            job.map = batch[job.approach].map;
+          else
+            build_source_map(job.map, players, grid, backend);
+          build_flee_map(job.map, grid, backend);
+          break;
+        case MapKind::HivePack:
+        {
+          std::vector<uint32_t> tiles = hives;
+          repair_dmap(job.map, job.sources, tiles, grid, backend);
+          break;
+        }
+      }
+    };
+    auto run_wave = [&](const std::vector<size_t> &wave)
+    {
+      jobs::parallel_for(wave.size(), [&](size_t, size_t begin, size_t end)
+      {
+        for (size_t k = begin; k < end; ++k)
+        {
+          MapJob &job = batch[wave[k]];
+          const bool persistent = is_persistent(requests[wave[k]].kind);
+          // repaired from last turn's codes, clamped ones would leave far tiles too close, an empty
+          // map makes repair_dmap rebuild it instead
+          if (persistent && !job.sources.rebuild)
+            decode_map(job.quantized, job.map);
+          build(wave[k]);
+          const bool exact = dmaps::quantize_map(job.map, job.quantized);
+          if (persistent)
+            job.sources.rebuild = !exact;
+        }
+      });
+    };
+    run_wave(firstWave);
+    run_wave(fleeWave); // approach map they start from is done by now
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+      MapJob &job = batch[i];
+      if (is_persistent(requests[i].kind))
+        requests[i].target.insert([&](DijkstraMapData &dmap, DmapSources &sources)
+        {
+          std::swap(dmap, job.quantized);
+          std::swap(sources, job.sources);
+        });
+      else
+        requests[i].target.set(std::move(job.quantized));
+    }
+  });
+}
@@ -1,11 +1,51 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <flecs.h>
+#include "ecsTypes.h"
 
 namespace dmaps
 {
-  void gen_player_approach_map(flecs::world &ecs, std::vector<float> &map);
+  // how full rebuilds propagate distances, both give identical maps
+  enum class Backend
+  {
+    BucketQueue, // only touches reachable tiles, good for narrow corridors
+    Sweep, // vectorized raster sweeps over whole rows, good for dense open caves
+    Auto // gen_maps picks Sweep when at most a tenth of the dungeon is wall, standalone generators take BucketQueue
+  };
+
+  // floor tiles as 0/1, built once and shared by every map of a batch
+  struct WalkMask
+  {
+    std::vector<uint8_t> walkable;
+    size_t width = 0;
+    size_t height = 0;
+  };
+  WalkMask make_walk_mask(const DungeonData &dd);
+
+  // keeps the smallest step (1/8 up to 1) that fits the map into the 16 bit codes, further tiles are clamped,
+  // returns false then
+  bool quantize_map(const std::vector<float> &map, DijkstraMapData &dmap);
+
+  void gen_player_approach_map(flecs::world &ecs, std::vector<float> &map, Backend backend = Backend::BucketQueue);
   void gen_player_flee_map(flecs::world &ecs, std::vector<float> &map);
-  void gen_hive_pack_map(flecs::world &ecs, std::vector<float> &map);
-};
+  void gen_hive_pack_map(flecs::world &ecs, std::vector<float> &map, Backend backend = Backend::BucketQueue);
 
+  enum class MapKind
+  {
+    PlayerApproach, // kept between turns and repaired around moved sources
+    PlayerFlee, // derived from the approach map
+    HivePack // kept between turns
+  };
+
+  struct MapRequest
+  {
+    flecs::entity target; // gets DijkstraMapData, maps kept between turns also store DmapSources there
+    MapKind kind;
+    Backend backend = Backend::Auto; // for full rebuilds, repairs of kept maps always use the bucket queue
+  };
+
+  // Builds all requested maps for this turn. The world is only read and written on the calling
+  // thread, maps themselves are built on the worker pool, the flee map reuses the approach map of the batch.
+  void gen_maps(flecs::world &ecs, const std::vector<MapRequest> &requests);
+};
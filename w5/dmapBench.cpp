@@ -0,0 +1,80 @@
+// compares dmap backends on a random open cave, both have to produce the same map
+#include <flecs.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "dijkstraMapGen.h"
+#include "dmapSweep.h"
+#include "dungeonUtils.h"
+#include "rng.h"
+
+template<typename Callable>
+static double time_ms(size_t iterations, Callable c)
+{
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  for (size_t i = 0; i < iterations; ++i)
+    c();
+  return std::chrono::duration<double, std::milli>(clock::now() - start).count() / double(iterations);
+}
+
+template<typename Callable>
+static void compare_backends(const char *name, size_t iterations, Callable gen)
+{
+  std::vector<float> queueMap;
+  std::vector<float> sweepMap;
+  const double queueTime = time_ms(iterations, [&]() { gen(queueMap, dmaps::Backend::BucketQueue); });
+  const double sweepTime = time_ms(iterations, [&]() { gen(sweepMap, dmaps::Backend::Sweep); });
+  printf("%-20s bucket queue: %8.3f ms, sweep: %8.3f ms, %s\n", name, queueTime, sweepTime,
+         queueMap == sweepMap ? "maps match" : "MAPS DIFFER");
+}
+
+// usage: hw5_dmap_bench [dungeon_size] [wall_percent] [num_sources] [iterations]
+int main(int argc, const char **argv)
+{
+  const size_t dungSize = argc > 1 ? size_t(atoi(argv[1])) : 256;
+  const int wallPercent = argc > 2 ? atoi(argv[2]) : 20;
+  const size_t numSources = argc > 3 ? size_t(atoi(argv[3])) : 8;
+  const size_t iterations = argc > 4 ? size_t(atoi(argv[4])) : 100;
+
+  rng::seed(42);
+  flecs::world ecs;
+  std::vector<char> tiles(dungSize * dungSize);
+  std::vector<Position> floorTiles;
+  for (size_t y = 0; y < dungSize; ++y)
+    for (size_t x = 0; x < dungSize; ++x)
+    {
+      const bool border = x == 0 || y == 0 || x + 1 == dungSize || y + 1 == dungSize;
+      const bool isWall = border || rng::range(0, 99) < wallPercent;
+      tiles[y * dungSize + x] = isWall ? dungeon::wall : dungeon::floor;
+      if (!isWall)
+        floorTiles.push_back(Position{int(x), int(y)});
+    }
+  if (floorTiles.empty())
+  {
+    printf("no floor tiles, lower wall_percent\n");
+    return 1;
+  }
+  init_dungeon(ecs, tiles.data(), dungSize, dungSize);
+  for (size_t i = 0; i < numSources; ++i)
+  {
+    const Position pos = floorTiles[size_t(rng::range(0, int(floorTiles.size()) - 1))];
+    ecs.entity().set(pos).set(Team{0});
+    ecs.entity().set(floorTiles[size_t(rng::range(0, int(floorTiles.size()) - 1))]).add<Hive>();
+  }
+
+  printf("dungeon %zux%zu, %d%% walls, %zu sources, sweep kernel: %s\n",
+         dungSize, dungSize, wallPercent, numSources, dmaps::sweep_kernel_name());
+  compare_backends("player_approach_map", iterations, [&](std::vector<float> &map, dmaps::Backend backend)
+  {
+    dmaps::gen_player_approach_map(ecs, map, backend);
+  });
+  compare_backends("hive_pack_map", iterations, [&](std::vector<float> &map, dmaps::Backend backend)
+  {
+    dmaps::gen_hive_pack_map(ecs, map, backend);
+  });
+  return 0;
+}
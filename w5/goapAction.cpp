@@ -1,41 +1,50 @@
 #include "goapAction.h"
 
-goap::Action goap::create_action(const char *name, const WorldDesc &desc, float cost)
+goap::Action goap::create_action(const char *name, const WorldDesc &, float cost)
 {
   Action res;
   res.name = name;
   res.cost = cost;
-  for (size_t i = 0; i < desc.size(); ++i)
-  {
-    res.precondition.push_back(-1);
-    res.effect.push_back(-1);
-    res.setBitset.push_back(true);
-  }
   return res;
 }
 
-void goap::set_action_precond(Action &act, const WorldDesc &desc, const char *st_name, int8_t val)
+static size_t find_var(const goap::WorldDesc &desc, const char *st_name)
 {
   auto itf = desc.find(st_name);
   if (itf == desc.end())
-    return; // TODO: Assert
-  act.precondition[itf->second] = val;
+    return size_t(-1); // TODO: Assert
+  return itf->second;
+}
+
+void goap::set_action_precond(Action &act, const WorldDesc &desc, const char *st_name, int8_t val)
+{
+  const size_t var = find_var(desc, st_name);
+  if (var == size_t(-1))
+    return;
+  // negative preconditions mean we don't care
+  set_lane(act.preMask, var, val < 0 ? 0 : int8_t(-1));
+  set_lane(act.preValue, var, val < 0 ? 0 : val);
 }
 
 void goap::set_action_effect(Action &act, const WorldDesc &desc, const char *st_name, int8_t val)
 {
-  auto itf = desc.find(st_name);
-  if (itf == desc.end())
-    return; // TODO: Assert
-  act.effect[itf->second] = val;
+  const size_t var = find_var(desc, st_name);
+  if (var == size_t(-1))
+    return;
+  // negative set effects leave the variable as is
+  set_lane(act.setMask, var, val < 0 ? 0 : int8_t(-1));
+  set_lane(act.setValue, var, val < 0 ? 0 : val);
+  set_lane(act.addValue, var, 0);
+  set_lane(act.addMask, var, 0);
 }
 
 void goap::set_additive_action_effect(Action &act, const WorldDesc &desc, const char *st_name, int8_t val)
 {
-  auto itf = desc.find(st_name);
-  if (itf == desc.end())
-    return; // TODO: Assert
-  act.effect[itf->second] = val;
-  act.setBitset[itf->second] = false;
+  const size_t var = find_var(desc, st_name);
+  if (var == size_t(-1))
+    return;
+  set_lane(act.setMask, var, 0);
+  set_lane(act.setValue, var, 0);
+  set_lane(act.addValue, var, val);
+  set_lane(act.addMask, var, int8_t(-1));
 }
-
@@ -9,10 +9,14 @@ namespace goap
   {
     std::string name = "";
 
-    WorldState precondition;
-    WorldState effect;
-
-    std::vector<bool> setBitset; // if effect sets world state, or is it additive (true - sets, false - additive)
+    // precondition holds where (state ^ preValue) & preMask is zero
+    WorldWords preMask = {};
+    WorldWords preValue = {};
+    // effect is (state & ~setMask | setValue) + addValue per lane
+    WorldWords setMask = {};
+    WorldWords setValue = {};
+    WorldWords addValue = {};
+    WorldWords addMask = {}; // lanes with an additive effect
 
     float cost = 1.f;
   };
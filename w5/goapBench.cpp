@@ -0,0 +1,205 @@
+// compares forward and backward GOAP search on the debug domains and on random solvable problems over them,
+// every plan has to replay legally
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "goapDomains.h"
+#include "rng.h"
+
+template<typename Callable>
+static double time_ms(size_t iterations, Callable c)
+{
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  for (size_t i = 0; i < iterations; ++i)
+    c();
+  return std::chrono::duration<double, std::milli>(clock::now() - start).count() / double(iterations);
+}
+
+// every step has to be applicable where it's taken and lead to the recorded state, the last one meets the goal
+// and the returned cost is what the steps cost
+static bool replays(const goap::Planner &pl, const GoapProblem &problem, const std::vector<goap::PlanStep> &plan, float cost)
+{
+  std::vector<size_t> valid;
+  goap::WorldState st = problem.from;
+  float stepsCost = 0.f;
+  for (const goap::PlanStep &step : plan)
+  {
+    goap::find_valid_state_transitions(pl, st, valid);
+    if (std::find(valid.begin(), valid.end(), step.action) == valid.end())
+      return false;
+    st = goap::apply_action(pl, step.action, st);
+    stepsCost += goap::get_action_cost(pl, step.action);
+    if (!(st == step.worldState))
+      return false;
+  }
+  if (stepsCost != cost)
+    return false;
+  for (size_t i = 0; i < problem.to.size(); ++i)
+    if (problem.to[i] >= 0 && problem.to[i] != st[i])
+      return plan.empty(); // no plan found
+  return true;
+}
+
+static bool solved(const GoapProblem &problem, const std::vector<goap::PlanStep> &plan)
+{
+  if (!plan.empty())
+    return true;
+  for (size_t i = 0; i < problem.to.size(); ++i)
+    if (problem.to[i] >= 0 && problem.to[i] != problem.from[i])
+      return false;
+  return true;
+}
+
+struct SearchResult
+{
+  double fwdTime = 0.0;
+  double bwdTime = 0.0;
+  std::vector<goap::PlanStep> fwdPlan;
+  std::vector<goap::PlanStep> bwdPlan;
+  float fwdCost = 0.f;
+  float bwdCost = 0.f;
+  bool legal = false;
+  bool agree = false; // both found a plan or both didn't
+};
+
+static SearchResult run_searches(const goap::Planner &pl, const GoapProblem &problem, size_t iterations)
+{
+  SearchResult res;
+  res.fwdTime = time_ms(iterations, [&]()
+  {
+    res.fwdPlan.clear();
+    res.fwdCost = goap::make_plan(pl, problem.from, problem.to, res.fwdPlan, goap::PlanSearch::Forward);
+  });
+  res.bwdTime = time_ms(iterations, [&]()
+  {
+    res.bwdPlan.clear();
+    res.bwdCost = goap::make_plan(pl, problem.from, problem.to, res.bwdPlan, goap::PlanSearch::Backward);
+  });
+  res.legal = replays(pl, problem, res.fwdPlan, res.fwdCost) && replays(pl, problem, res.bwdPlan, res.bwdCost);
+  res.agree = solved(problem, res.fwdPlan) == solved(problem, res.bwdPlan);
+  return res;
+}
+
+static bool compare_searches(const char *name, goap::Planner &pl, const std::vector<GoapProblem> &problems, size_t iterations)
+{
+  pl.cache.set_capacity(0); // every iteration has to search
+  bool ok = true;
+  for (size_t i = 0; i < problems.size(); ++i)
+  {
+    const SearchResult res = run_searches(pl, problems[i], iterations);
+    printf("%s #%zu forward: %8.4f ms (%zu steps, cost %g), backward: %8.4f ms (%zu steps, cost %g), %s, %s\n",
+           name, i, res.fwdTime, res.fwdPlan.size(), double(res.fwdCost),
+           res.bwdTime, res.bwdPlan.size(), double(res.bwdCost),
+           res.fwdCost == res.bwdCost ? "costs match" : "costs differ", res.legal ? "plans replay" : "INVALID PLAN");
+    ok &= res.legal && res.agree;
+  }
+  return ok;
+}
+
+struct VarRange
+{
+  const char *name;
+  int lo;
+  int hi;
+};
+
+// Random starts over every variable. Goals pick one to three variables of the state a random walk of
+// legal actions ends in, so every problem has a plan and unsolvable ones don't dominate the timing.
+static std::vector<GoapProblem> random_problems(const goap::Planner &pl, const std::vector<VarRange> &vars, size_t count)
+{
+  std::vector<GoapProblem> res;
+  std::vector<size_t> valid;
+  for (size_t i = 0; i < count; ++i)
+  {
+    goap::WorldStateList from;
+    for (const VarRange &var : vars)
+      from.emplace_back(var.name, rng::range(var.lo, var.hi));
+    const goap::WorldState start = goap::produce_planner_worldstate(pl, from);
+
+    goap::WorldState end = start;
+    const int walkLen = rng::range(1, 8);
+    for (int step = 0; step < walkLen; ++step)
+    {
+      goap::find_valid_state_transitions(pl, end, valid);
+      if (valid.empty())
+        break;
+      end = goap::apply_action(pl, valid[size_t(rng::range(0, int(valid.size()) - 1))], end);
+    }
+
+    goap::WorldState goal = goap::produce_planner_worldstate(pl, {});
+    const int numGoals = rng::range(1, 3);
+    for (int g = 0; g < numGoals; ++g)
+    {
+      const size_t var = size_t(rng::range(0, int(goal.size()) - 1));
+      if (end[var] >= 0) // goals can't ask for negative values
+        goal.set(var, end[var]);
+    }
+    res.push_back({start, goal});
+  }
+  return res;
+}
+
+// A heuristic that counts one per unit of difference overestimates actions setting several variables,
+// so the searches don't always find plans of the same cost. Only legality and solving every problem are checked.
+static bool compare_random(const char *name, goap::Planner &pl, const std::vector<GoapProblem> &problems)
+{
+  pl.cache.set_capacity(0);
+  bool ok = true;
+  double fwdTime = 0.0;
+  double bwdTime = 0.0;
+  size_t fwdSolved = 0, bwdSolved = 0, costDiffs = 0, invalid = 0, disagree = 0;
+  for (const GoapProblem &problem : problems)
+  {
+    const SearchResult res = run_searches(pl, problem, 1);
+    fwdTime += res.fwdTime;
+    bwdTime += res.bwdTime;
+    fwdSolved += solved(problem, res.fwdPlan);
+    bwdSolved += solved(problem, res.bwdPlan);
+    costDiffs += res.fwdCost != res.bwdCost;
+    invalid += !res.legal;
+    disagree += !res.agree;
+    ok &= res.legal && solved(problem, res.fwdPlan) && solved(problem, res.bwdPlan);
+  }
+  printf("%s random x%zu forward: %8.3f ms (%zu solved), backward: %8.3f ms (%zu solved), %zu cost differences, %s\n",
+         name, problems.size(), fwdTime, fwdSolved, bwdTime, bwdSolved, costDiffs,
+         ok ? "plans replay" : "INVALID PLANS");
+  if (!ok)
+    printf("  %zu invalid plans, %zu problems solved by one search only\n", invalid, disagree);
+  return ok;
+}
+
+// usage: hw5_goap_bench [iterations] [random_problems]
+int main(int argc, const char **argv)
+{
+  const size_t iterations = argc > 1 ? size_t(atoi(argv[1])) : 1000;
+  const size_t numRandom = argc > 2 ? size_t(atoi(argv[2])) : 500;
+
+  rng::seed(42);
+  bool ok = true;
+  goap::Planner enemy = create_enemy_debug_planner();
+  ok &= compare_searches("enemy", enemy, enemy_debug_problems(enemy), iterations);
+  ok &= compare_random("enemy", enemy, random_problems(enemy,
+      {{"enemy_vis", 0, 1},
+       {"enemy_alive", 0, 1},
+       {"have_melee", 0, 1},
+       {"have_ranged", 0, 1},
+       {"enemy_dist", DistMelee, DistFar},
+       {"health_state", Dead, Healthy}}, numRandom));
+
+  goap::Planner looter = create_looter_debug_planner();
+  ok &= compare_searches("looter", looter, looter_debug_problems(looter), iterations);
+  ok &= compare_random("looter", looter, random_problems(looter,
+      {{"enemy_vis", 0, 1},
+       {"loot_vis", 0, 1},
+       {"num_loot", 0, 5},
+       {"have_melee", 0, 1},
+       {"have_ranged", 0, 1},
+       {"enemy_dist", DistMelee, DistFar},
+       {"health_state", Dead, Healthy},
+       {"escaped", 0, 1},
+       {"blessed", 0, 5}}, numRandom));
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include "goapDomains.h"
+
+goap::Planner create_enemy_debug_planner()
+{
+  goap::Planner pl = goap::create_planner();
+
+  goap::add_states_to_planner(pl,
+      {"enemy_vis",
+       "enemy_alive",
+       "have_melee",
+       "have_ranged",
+       "enemy_dist",
+       "health_state"});
+
+  goap::add_action_to_planner(pl, "wander", 1,
+      {{"health_state", Healthy}},
+      {{"enemy_vis", 1}},
+      {});
+
+  goap::add_action_to_planner(pl, "approach_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", -1}});
+
+  goap::add_action_to_planner(pl, "flee_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", +1}});
+
+  goap::add_action_to_planner(pl, "find_melee", 1,
+      {{"have_melee", 0}, {"health_state", Healthy}, {"enemy_vis", 0}},
+      {{"have_melee", 1}},
+      {});
+
+  /*
+  goap::add_action_to_planner(pl, "find_ranged", 1,
+      {{"have_ranged", 0}, {"health_state", Healthy}},
+      {{"have_ranged", 1}},
+      {});
+      */
+
+  goap::add_action_to_planner(pl, "patch_up", 1,
+      {{"health_state", Injured}},
+      {},
+      {{"health_state", +1}});
+
+  goap::add_action_to_planner(pl, "attack_enemy", 1,
+      {{"enemy_vis", 1}, {"enemy_alive", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
+      {{"enemy_alive", 0}},
+      {{"health_state", -1}});
+
+  goap::add_action_to_planner(pl, "shoot_enemy", 1,
+      {{"enemy_vis", 1}, {"enemy_alive", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
+      {{"enemy_alive", 0}},
+      {});
+
+  return pl;
+}
+
+std::vector<GoapProblem> enemy_debug_problems(const goap::Planner &pl)
+{
+  return {
+    {goap::produce_planner_worldstate(pl,
+         {{"enemy_vis", 0},
+          {"enemy_alive", 1},
+          {"have_melee", 0},
+          {"have_ranged", 0},
+          {"enemy_dist", DistFar},
+          {"health_state", Healthy}}),
+     goap::produce_planner_worldstate(pl,
+         {{"enemy_alive", 0}, {"health_state", Healthy}})},
+    {goap::produce_planner_worldstate(pl,
+         {{"enemy_vis", 1},
+          {"enemy_alive", 1},
+          {"have_melee", 0},
+          {"have_ranged", 0},
+          {"enemy_dist", DistMelee},
+          {"health_state", Injured}}),
+     goap::produce_planner_worldstate(pl,
+         {{"enemy_alive", 0}, {"health_state", Healthy}, {"enemy_dist", DistFar}})}};
+}
+
+goap::Planner create_looter_debug_planner()
+{
+  goap::Planner pl = goap::create_planner();
+
+  goap::add_states_to_planner(pl,
+      {"enemy_vis",
+       "loot_vis",
+       "num_loot",
+       "have_melee",
+       "have_ranged",
+       "enemy_dist",
+       "health_state",
+       "escaped",
+       "blessed"});
+
+  goap::add_action_to_planner(pl, "open_room", 1,
+      {{"health_state", Healthy}},
+      {{"enemy_vis", 1}, {"loot_vis", 1}, {"enemy_dist", 2}},
+      {});
+
+  /*
+  goap::add_action_to_planner(pl, "pray", 1,
+      {{"health_state", Healthy}},
+      {},
+      {{"blessed", +1}});
+      */
+
+  goap::add_action_to_planner(pl, "loot", 1,
+      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}},
+      {{"loot_vis", 0}},
+      {{"num_loot", +1}});
+
+  goap::add_action_to_planner(pl, "loot_blessed", 1,
+      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}, {"blessed", 5}},
+      {{"loot_vis", 0}},
+      {{"num_loot", +2}});
+
+
+  goap::add_action_to_planner(pl, "loot_dang", 1,
+      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 1}},
+      {{"loot_vis", 0}},
+      {{"num_loot", +1}, {"health_state", -1}});
+
+
+  goap::add_action_to_planner(pl, "approach_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", -1}});
+
+  goap::add_action_to_planner(pl, "flee_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", +1}});
+
+  goap::add_action_to_planner(pl, "find_melee", 1,
+      {{"have_melee", 0}, {"health_state", Healthy}},
+      {{"have_melee", 1}},
+      {});
+
+  goap::add_action_to_planner(pl, "find_ranged", 1,
+      {{"have_ranged", 0}, {"health_state", Healthy}},
+      {{"have_ranged", 1}},
+      {});
+
+  goap::add_action_to_planner(pl, "patch_up", 1,
+      {{"health_state", Injured}},
+      {},
+      {{"health_state", +1}});
+
+  goap::add_action_to_planner(pl, "attack_enemy", 1,
+      {{"enemy_vis", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
+      {{"enemy_vis", 0}},
+      {{"health_state", -1}});
+
+  goap::add_action_to_planner(pl, "shoot_enemy", 1,
+      {{"enemy_vis", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
+      {{"enemy_vis", 0}},
+      {});
+
+  goap::add_action_to_planner(pl, "hide", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {{"enemy_vis", 0}},
+      {});
+
+  goap::add_action_to_planner(pl, "escape", 1,
+      {{"health_state", Healthy}, {"num_loot", 5}},
+      {{"escaped", 1}},
+      {});
+
+  return pl;
+}
+
+std::vector<GoapProblem> looter_debug_problems(const goap::Planner &pl)
+{
+  return {
+    {goap::produce_planner_worldstate(pl,
+         {{"enemy_vis", 0},
+          {"loot_vis", 1},
+          {"num_loot", 0},
+          {"have_melee", 1},
+          {"have_ranged", 1},
+          {"enemy_dist", DistFar},
+          {"health_state", Healthy},
+          {"escaped", 0},
+          {"blessed", 0}}),
+     goap::produce_planner_worldstate(pl,
+         {{"num_loot", 5}, {"escaped", 1}, {"health_state", Healthy}})}};
+}
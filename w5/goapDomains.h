@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include "goapPlanner.h"
+
+enum EnemyDist
+{
+  DistMelee = 0,
+  DistRanged,
+  DistFar
+};
+
+enum HealthState
+{
+  Dead = 0,
+  Injured,
+  Healthy
+};
+
+// debug domains shared by the game and the planner benchmark
+struct GoapProblem
+{
+  goap::WorldState from;
+  goap::WorldState to;
+};
+
+goap::Planner create_enemy_debug_planner();
+std::vector<GoapProblem> enemy_debug_problems(const goap::Planner &pl);
+
+goap::Planner create_looter_debug_planner();
+std::vector<GoapProblem> looter_debug_problems(const goap::Planner &pl);
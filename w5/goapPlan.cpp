@@ -1,16 +1,101 @@
 #include "goapPlanner.h"
 #include <algorithm>
+#include <unordered_map>
 
 struct PlanNode
 {
   goap::WorldState worldState;
-  goap::WorldState prevState;
-  float prevG;
+  uint32_t parent; // index in the search arena, the start node is its own parent
 
   float g = 0;
   float h = 0;
 
   size_t actionId;
+
+  uint64_t hash = 0;
+  uint32_t heapPos = 0; // in the open list, closed_pos once expanded
+};
+
+static constexpr uint32_t closed_pos = uint32_t(-1);
+
+// Binary min-heap of node indices ordered by f, ties go to the node created first. Nodes keep their
+// heap position, so a cheaper path moves its node up in place.
+class OpenList
+{
+public:
+  explicit OpenList(std::vector<PlanNode> &in_nodes) : nodes(in_nodes) {}
+
+  bool empty() const { return heap.empty(); }
+  void clear() { heap.clear(); }
+
+  void push(uint32_t idx)
+  {
+    heap.push_back(idx);
+    sift_up(heap.size() - 1);
+  }
+
+  uint32_t pop()
+  {
+    const uint32_t top = heap.front();
+    nodes[top].heapPos = closed_pos;
+    const uint32_t last = heap.back();
+    heap.pop_back();
+    if (!heap.empty())
+    {
+      place(0, last);
+      sift_down(0);
+    }
+    return top;
+  }
+
+  // g of an open node went down
+  void decreased(uint32_t idx) { sift_up(nodes[idx].heapPos); }
+
+private:
+  bool less(uint32_t lhs, uint32_t rhs) const
+  {
+    const float lf = nodes[lhs].g + nodes[lhs].h;
+    const float rf = nodes[rhs].g + nodes[rhs].h;
+    return lf < rf || (lf == rf && lhs < rhs);
+  }
+
+  void place(size_t pos, uint32_t idx)
+  {
+    heap[pos] = idx;
+    nodes[idx].heapPos = uint32_t(pos);
+  }
+
+  void sift_up(size_t pos)
+  {
+    const uint32_t idx = heap[pos];
+    while (pos > 0 && less(idx, heap[(pos - 1) / 2]))
+    {
+      place(pos, heap[(pos - 1) / 2]);
+      pos = (pos - 1) / 2;
+    }
+    place(pos, idx);
+  }
+
+  void sift_down(size_t pos)
+  {
+    const uint32_t idx = heap[pos];
+    for (;;)
+    {
+      size_t child = pos * 2 + 1;
+      if (child >= heap.size())
+        break;
+      if (child + 1 < heap.size() && less(heap[child + 1], heap[child]))
+        ++child;
+      if (!less(heap[child], idx))
+        break;
+      place(pos, heap[child]);
+      pos = child;
+    }
+    place(pos, idx);
+  }
+
+  std::vector<PlanNode> &nodes;
+  std::vector<uint32_t> heap;
 };
 
 static float heuristic(const goap::WorldState &from, const goap::WorldState &to)
@@ -22,69 +107,137 @@ static float heuristic(const goap::WorldState &from, const goap::WorldState &to)
   return cost;
 }
 
-static void reconstruct_plan(PlanNode &goal_node, const std::vector<PlanNode> &closed, std::vector<goap::PlanStep> &plan)
+// Every node opened by a search, indices stay valid while it runs and the open list and the state lookup
+// refer to them. Cleared rather than freed between searches so repeated planning keeps its capacity.
+struct PlanArena
 {
-  PlanNode &curNode = goal_node;
-  while (curNode.actionId != size_t(-1))
+  std::vector<PlanNode> nodes;
+  std::unordered_multimap<uint64_t, uint32_t> nodeByHash;
+  OpenList openList{nodes};
+  std::vector<size_t> transitions;
+
+  void clear()
   {
-    plan.push_back({curNode.actionId, curNode.worldState});
-    auto itf = std::find_if(closed.begin(), closed.end(), [&](const PlanNode &n) { return n.worldState == curNode.prevState && n.g == curNode.prevG; });
-    curNode = *itf;
+    nodes.clear();
+    nodeByHash.clear();
+    openList.clear();
   }
-  std::reverse(plan.begin(), plan.end());
-}
+};
 
-float goap::make_plan(const Planner &planner, const WorldState &from, const WorldState &to, std::vector<PlanStep> &plan)
+// A* over states from start, expand calls add(actId, cost, state) for every successor and goal nodes are the
+// ones with zero heuristic. Returns the index of the goal node in the arena or -1.
+template<typename Expand, typename Heuristic>
+static uint32_t astar(PlanArena &arena, const goap::WorldState &start, Expand expand, Heuristic heur)
 {
-  std::vector<PlanNode> openList = {PlanNode{from, from, -1, 0, heuristic(from, to), size_t(-1)}};
-  std::vector<PlanNode> closedList = {};
+  std::vector<PlanNode> &nodes = arena.nodes;
+  OpenList &openList = arena.openList;
+  arena.clear();
+  nodes.push_back(PlanNode{start, 0, 0, heur(start), size_t(-1), goap::hash_state(start)});
+  arena.nodeByHash.emplace(nodes[0].hash, 0);
+  openList.push(0);
   while (!openList.empty())
   {
-    auto minIt = openList.begin();
-    float minF = minIt->g + minIt->h;
-    for (auto it = openList.begin(); it != openList.end(); ++it)
-      if (it->g + it->h < minF)
-      {
-        minF = it->g + it->h;
-        minIt = it;
-      }
-    PlanNode cur = *minIt;
-    openList.erase(minIt);
-    if (heuristic(cur.worldState, to) == 0) // we've reached our goal
-    {
-      reconstruct_plan(cur, closedList, plan);
-      return minF;
-    }
-    closedList.push_back(cur);
-    std::vector<size_t> transitions = find_valid_state_transitions(planner, cur.worldState);
-    //const bool firstIter = openList.empty();
-    //printf("------------\n");
-    for (size_t actId : transitions)
+    const uint32_t curIdx = openList.pop();
+    if (nodes[curIdx].h == 0) // we've reached our goal
+      return curIdx;
+    const goap::WorldState curState = nodes[curIdx].worldState; // nodes may grow below
+    const float curG = nodes[curIdx].g;
+    expand(curState, [&](size_t actId, float cost, const goap::WorldState &st)
     {
-      //printf("valid action: %s\n", planner.actions[actId].name.c_str());
-      WorldState st = apply_action(planner, actId, cur.worldState);
-      const float score = cur.g + get_action_cost(planner, actId);
-      auto openIt = std::find_if(openList.begin(), openList.end(), [&](const PlanNode &n) { return st == n.worldState; });
-      auto closeIt = std::find_if(closedList.begin(), closedList.end(), [&](const PlanNode &n) { return st == n.worldState; });
-      if (openIt != openList.end() && score < openIt->g)
+      const float score = curG + cost;
+      const uint64_t hash = goap::hash_state(st);
+      uint32_t found = uint32_t(-1);
+      for (auto [it, end] = arena.nodeByHash.equal_range(hash); it != end; ++it)
+        if (nodes[it->second].worldState == st)
+        {
+          found = it->second;
+          break;
+        }
+      if (found == uint32_t(-1))
       {
-        openIt->g = score;
-        openIt->prevState = cur.worldState;
-        openIt->prevG = cur.g;
-        openIt->h = heuristic(st, to);
+        const uint32_t idx = uint32_t(nodes.size());
+        nodes.push_back({st, curIdx, score, heur(st), actId, hash});
+        arena.nodeByHash.emplace(hash, idx);
+        openList.push(idx);
       }
-      if (closeIt != closedList.end() && score < closeIt->g)
+      else if (score < nodes[found].g)
       {
-        closeIt->g = score;
-        closeIt->prevState = cur.worldState;
-        closeIt->prevG = cur.g;
-        closeIt->h = heuristic(st, to);
+        // closed nodes are opened again so their successors get the cheaper g as well
+        PlanNode &node = nodes[found];
+        node.g = score;
+        node.parent = curIdx;
+        node.actionId = actId;
+        if (node.heapPos != closed_pos)
+          openList.decreased(found);
+        else
+          openList.push(found);
       }
-      if (closeIt == closedList.end() && openIt == openList.end())
-        openList.push_back({st, cur.worldState, cur.g, score, heuristic(st, to), actId});
-    }
+    });
   }
-  return 0.f;
+  return uint32_t(-1);
+}
+
+static float search_forward(const goap::Planner &planner, const goap::WorldState &from, const goap::WorldState &to,
+                            std::vector<goap::PlanStep> &plan)
+{
+  thread_local PlanArena arena;
+  const uint32_t goalIdx = astar(arena, from, [&](const goap::WorldState &cur, auto add)
+  {
+    goap::find_valid_state_transitions(planner, cur, arena.transitions);
+    for (size_t actId : arena.transitions)
+      add(actId, goap::get_action_cost(planner, actId), goap::apply_action(planner, actId, cur));
+  }, [&](const goap::WorldState &st) { return heuristic(st, to); });
+  if (goalIdx == uint32_t(-1))
+    return 0.f;
+  const std::vector<PlanNode> &nodes = arena.nodes;
+  float cost = 0.f;
+  for (uint32_t idx = goalIdx; nodes[idx].actionId != size_t(-1); idx = nodes[idx].parent)
+  {
+    plan.push_back({nodes[idx].actionId, nodes[idx].worldState});
+    cost += goap::get_action_cost(planner, nodes[idx].actionId);
+  }
+  std::reverse(plan.begin(), plan.end());
+  return cost;
+}
+
+// Nodes are goal conditions, the search is done once the start state meets them. Going back up the
+// parents gives the actions in execution order, states are replayed from the start.
+static float search_backward(const goap::Planner &planner, const goap::WorldState &from, const goap::WorldState &to,
+                             std::vector<goap::PlanStep> &plan)
+{
+  thread_local PlanArena arena;
+  const uint32_t goalIdx = astar(arena, to, [&](const goap::WorldState &cur, auto add)
+  {
+    goap::WorldState cond;
+    for (size_t actId = 0; actId < planner.actions.size(); ++actId)
+      if (goap::regress_goal(planner, actId, cur, cond))
+        add(actId, goap::get_action_cost(planner, actId), cond);
+  }, [&](const goap::WorldState &st) { return heuristic(from, st); });
+  if (goalIdx == uint32_t(-1))
+    return 0.f;
+  const std::vector<PlanNode> &nodes = arena.nodes;
+  goap::WorldState st = from;
+  float cost = 0.f;
+  for (uint32_t idx = goalIdx; nodes[idx].actionId != size_t(-1); idx = nodes[idx].parent)
+  {
+    st = goap::apply_action(planner, nodes[idx].actionId, st);
+    plan.push_back({nodes[idx].actionId, st});
+    cost += goap::get_action_cost(planner, nodes[idx].actionId);
+  }
+  return cost;
+}
+
+float goap::make_plan(const Planner &planner, const WorldState &from, const WorldState &to, std::vector<PlanStep> &plan,
+                      PlanSearch search)
+{
+  float cost = 0.f;
+  if (planner.cache.find(from, to, search, plan, cost))
+    return cost;
+  std::vector<PlanStep> found;
+  cost = search == PlanSearch::Backward ? search_backward(planner, from, to, found) : search_forward(planner, from, to, found);
+  planner.cache.insert(from, to, search, found, cost); // failed searches are cached too
+  plan.insert(plan.end(), found.begin(), found.end());
+  return cost;
 }
 
 void goap::print_plan(const Planner &planner, const WorldState &init, const std::vector<PlanStep> &plan)
@@ -0,0 +1,100 @@
+#include "goapPlanner.h"
+
+static uint64_t cache_key(const goap::WorldState &from, const goap::WorldState &to, goap::PlanSearch search)
+{
+  return goap::hash_state(from) ^ (goap::hash_state(to) * 0x9e3779b97f4a7c15ull) ^ uint64_t(unsigned(search));
+}
+
+goap::PlanCache::PlanCache(PlanCache &&other)
+{
+  std::lock_guard<std::mutex> guard(other.mtx);
+  capacity = other.capacity;
+  entries = std::move(other.entries);
+  byKey = std::move(other.byKey);
+  hits = other.hits;
+  misses = other.misses;
+}
+
+goap::PlanCache &goap::PlanCache::operator=(PlanCache &&other)
+{
+  if (this == &other)
+    return *this;
+  std::scoped_lock guard(mtx, other.mtx);
+  capacity = other.capacity;
+  entries = std::move(other.entries);
+  byKey = std::move(other.byKey);
+  hits = other.hits;
+  misses = other.misses;
+  return *this;
+}
+
+bool goap::PlanCache::find(const WorldState &from, const WorldState &to, PlanSearch search, std::vector<PlanStep> &plan, float &cost)
+{
+  const uint64_t key = cache_key(from, to, search);
+  std::lock_guard<std::mutex> guard(mtx);
+  for (auto [it, end] = byKey.equal_range(key); it != end; ++it)
+  {
+    const Entry &entry = *it->second;
+    if (entry.from == from && entry.to == to && entry.search == search)
+    {
+      entries.splice(entries.begin(), entries, it->second); // iterators stay valid
+      plan.insert(plan.end(), entry.plan.begin(), entry.plan.end());
+      cost = entry.cost;
+      ++hits;
+      return true;
+    }
+  }
+  ++misses;
+  return false;
+}
+
+void goap::PlanCache::insert(const WorldState &from, const WorldState &to, PlanSearch search, const std::vector<PlanStep> &plan, float cost)
+{
+  const uint64_t key = cache_key(from, to, search);
+  std::lock_guard<std::mutex> guard(mtx);
+  if (capacity == 0)
+    return;
+  // another agent may have planned the same query meanwhile
+  for (auto [it, end] = byKey.equal_range(key); it != end; ++it)
+    if (it->second->from == from && it->second->to == to && it->second->search == search)
+      return;
+  entries.push_front(Entry{from, to, search, plan, cost});
+  byKey.emplace(key, entries.begin());
+  evict();
+}
+
+void goap::PlanCache::clear()
+{
+  std::lock_guard<std::mutex> guard(mtx);
+  entries.clear();
+  byKey.clear();
+}
+
+void goap::PlanCache::set_capacity(size_t cap)
+{
+  std::lock_guard<std::mutex> guard(mtx);
+  capacity = cap;
+  evict();
+}
+
+goap::PlanCacheStats goap::PlanCache::stats() const
+{
+  std::lock_guard<std::mutex> guard(mtx);
+  return PlanCacheStats{hits, misses, entries.size()};
+}
+
+// drops least recently used entries past capacity, expects the lock to be held
+void goap::PlanCache::evict()
+{
+  while (entries.size() > capacity)
+  {
+    const Entry &last = entries.back();
+    for (auto [it, end] = byKey.equal_range(cache_key(last.from, last.to, last.search)); it != end; ++it)
+      if (it->second == std::prev(entries.end()))
+      {
+        byKey.erase(it);
+        break;
+      }
+    entries.pop_back();
+  }
+}
@@ -1,14 +1,25 @@
 #include "goapPlanner.h"
+#include <algorithm>
+#include <cassert>
 
 goap::Planner goap::create_planner()
 {
   return Planner();
 }
 
-void goap::add_states_to_planner(Planner &planner, const std::vector<std::string> &state_names)
+bool goap::add_states_to_planner(Planner &planner, const std::vector<std::string> &state_names)
 {
+  invalidate_plan_cache(planner);
   for (const std::string &name : state_names)
+  {
+    if (planner.wdesc.size() == max_world_vars && !planner.wdesc.count(name))
+    {
+      assert(!"too many goap state variables, raise max_world_vars");
+      return false;
+    }
     planner.wdesc.emplace(name, planner.wdesc.size());
+  }
+  return true;
 }
 
 
@@ -26,21 +37,23 @@ void goap::add_action_to_planner(Planner &planner, const char *name, float cost,
 
   planner.actionNames.emplace(name, planner.actions.size());
   planner.actions.emplace_back(act);
+  invalidate_plan_cache(planner);
 }
 
 static void set_planner_worldstate(const goap::Planner &planner, goap::WorldState &st, const char *st_name, int8_t val)
 {
   auto itf = planner.wdesc.find(st_name);
-  if (itf == planner.wdesc.end())
+  if (itf == planner.wdesc.end() || itf->second >= st.size())
     return;
-  st[itf->second] = val;
+  st.set(itf->second, val);
 }
 
 goap::WorldState goap::produce_planner_worldstate(const Planner &planner, const WorldStateList &states)
 {
   WorldState res;
-  for (size_t i = 0; i < planner.wdesc.size(); ++i)
-    res.emplace_back(int8_t(-1));
+  res.count = uint32_t(planner.wdesc.size()); // add_states_to_planner keeps it within max_world_vars
+  for (size_t i = 0; i < res.size(); ++i)
+    res.set(i, int8_t(-1));
   for (auto st : states)
     set_planner_worldstate(planner, res, st.first, int8_t(st.second));
   return res;
@@ -51,44 +64,71 @@ float goap::get_action_cost(const Planner &planner, size_t act_id)
   return planner.actions[act_id].cost;
 }
 
-static bool not_eq_states(const goap::WorldState& lhs, const goap::WorldState& rhs)
+void goap::set_action_cost(Planner &planner, size_t act_id, float cost)
+{
+  planner.actions[act_id].cost = cost;
+  invalidate_plan_cache(planner);
+}
+
+void goap::invalidate_plan_cache(Planner &planner)
 {
-  if (lhs.size() != rhs.size())
-    return true;
-  for (size_t i = 0; i < lhs.size(); ++i)
-    if (lhs[i] != rhs[i])
-      return true;
-  return false;
+  planner.cache.clear();
 }
 
-std::vector<size_t> goap::find_valid_state_transitions(const Planner &planner, const WorldState &from)
+goap::PlanCacheStats goap::get_plan_cache_stats(const Planner &planner)
 {
-  std::vector<size_t> res;
+  return planner.cache.stats();
+}
 
+void goap::find_valid_state_transitions(const Planner &planner, const WorldState &from, std::vector<size_t> &res)
+{
+  res.clear();
   for (size_t i = 0; i < planner.actions.size(); ++i)
   {
     const Action &action = planner.actions[i];
     bool isValidAction = true;
-    for (size_t j = 0; j < action.precondition.size() && isValidAction; ++j)
-      isValidAction &= action.precondition[j] < 0 || from[j] == action.precondition[j];
-    WorldState newWs = apply_action(planner, i, from);
-    if (isValidAction && not_eq_states(newWs, from))
+    for (size_t w = 0; w < from.words.size(); ++w)
+      isValidAction &= ((from.words[w] ^ action.preValue[w]) & action.preMask[w]) == 0;
+    // set effects that write a different value or any non-zero additive effect change the state
+    bool changes = false;
+    for (size_t w = 0; w < from.words.size(); ++w)
+      changes |= (from.words[w] & action.setMask[w]) != action.setValue[w] || action.addValue[w] != 0;
+    if (isValidAction && changes)
       res.emplace_back(i);
   }
-  return res;
 }
 
 goap::WorldState goap::apply_action(const Planner &planner, size_t act, const WorldState &from)
 {
   WorldState res = from;
   const Action &action = planner.actions[act];
-  for (size_t i = 0; i < action.effect.size(); ++i)
-  {
-    if (!action.setBitset[i])
-      res[i] += action.effect[i];
-    else if (action.effect[i] >= 0)
-      res[i] = action.effect[i];
-  }
+  for (size_t w = 0; w < res.words.size(); ++w)
+    res.words[w] = add_lanes((res.words[w] & ~action.setMask[w]) | action.setValue[w], action.addValue[w]);
   return res;
 }
 
+bool goap::regress_goal(const Planner &planner, size_t act, const WorldState &goal, WorldState &res)
+{
+  const Action &action = planner.actions[act];
+  bool achieves = false;
+  res = goal;
+  for (size_t w = 0; w < goal.words.size(); ++w)
+  {
+    // lanes of the goal we care about, non-negative values within the state
+    const size_t lanes = std::min(goal.size() - std::min(goal.size(), w * 8), size_t(8));
+    const uint64_t inState = lanes == 8 ? ~uint64_t(0) : (uint64_t(1) << (lanes * 8)) - 1;
+    const uint64_t care = ((~goal.words[w] & 0x8080808080808080ull) >> 7) * 0xff & inState;
+    if (care & action.setMask[w] & (goal.words[w] ^ action.setValue[w]))
+      return false; // sets a goal variable to something else
+    achieves |= (care & (action.setMask[w] | action.addMask[w])) != 0;
+
+    // variables the action sets are free before it, additive ones need the value minus the effect
+    uint64_t cond = sub_lanes(goal.words[w] | action.setMask[w], action.addValue[w] & care);
+    if (cond & care & action.addMask[w] & 0x8080808080808080ull)
+      return false; // goals never ask for negative values
+    if (care & ~action.setMask[w] & action.preMask[w] & (cond ^ action.preValue[w]))
+      return false; // precondition contradicts what has to hold anyway
+    res.words[w] = (cond & ~action.preMask[w]) | action.preValue[w];
+  }
+  return achieves;
+}
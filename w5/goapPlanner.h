@@ -1,4 +1,6 @@
 #pragma once
+#include <list>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -8,12 +10,66 @@
 
 namespace goap
 {
+  struct PlanStep
+  {
+    size_t action;
+    WorldState worldState;
+  };
+
+  enum class PlanSearch
+  {
+    Forward,  // from the start state over every applicable action
+    Backward  // from the goal conditions over the actions achieving one of them
+  };
+
+  struct PlanCacheStats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t size = 0;
+  };
+
+  // LRU of finished plans keyed by (start, goal), shared by every agent planning with the same planner.
+  // Guarded by a mutex so agents can plan from worker threads, the search itself runs outside the lock.
+  class PlanCache
+  {
+  public:
+    explicit PlanCache(size_t capacity = 256) : capacity(capacity) {}
+    PlanCache(PlanCache &&other);
+    PlanCache &operator=(PlanCache &&other);
+
+    bool find(const WorldState &from, const WorldState &to, PlanSearch search, std::vector<PlanStep> &plan, float &cost);
+    void insert(const WorldState &from, const WorldState &to, PlanSearch search, const std::vector<PlanStep> &plan, float cost);
+    void clear();
+    void set_capacity(size_t cap);
+    PlanCacheStats stats() const;
+
+  private:
+    struct Entry
+    {
+      WorldState from;
+      WorldState to;
+      PlanSearch search; // searches may find different plans of the same cost
+      std::vector<PlanStep> plan;
+      float cost;
+    };
+
+    void evict();
+
+    mutable std::mutex mtx;
+    size_t capacity;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> byKey;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
 
   struct Planner
   {
     WorldDesc wdesc;
     std::vector<Action> actions;
     std::unordered_map<std::string, size_t> actionNames;
+    mutable PlanCache cache; // cleared whenever states, actions or costs change
   };
 
   Planner create_planner();
@@ -27,21 +83,26 @@ namespace goap
                                                                              const Effect &effect,
                                                                              const Effect &additive_effect);
 
-  void add_states_to_planner(Planner &planner, const std::vector<std::string> &state_names);
+  // false once the planner would need more than max_world_vars variables, the rest aren't added
+  bool add_states_to_planner(Planner &planner, const std::vector<std::string> &state_names);
   WorldState produce_planner_worldstate(const Planner &planner, const WorldStateList &states);
 
   float get_action_cost(const Planner &planner, size_t act_id);
+  void set_action_cost(Planner &planner, size_t act_id, float cost);
 
-  std::vector<size_t> find_valid_state_transitions(const Planner &planner, const WorldState &from);
-  WorldState apply_action(const Planner &planner, size_t act, const WorldState &from);
+  // for changes made to planner.actions directly
+  void invalidate_plan_cache(Planner &planner);
+  PlanCacheStats get_plan_cache_stats(const Planner &planner);
 
-  struct PlanStep
-  {
-    size_t action;
-    WorldState worldState;
-  };
+  // fills res with the actions applicable in from that change it
+  void find_valid_state_transitions(const Planner &planner, const WorldState &from, std::vector<size_t> &res);
+  WorldState apply_action(const Planner &planner, size_t act, const WorldState &from);
+  // Conditions that have to hold before act so that goal holds after it, negative values are don't care
+  // like in goals. False if act doesn't achieve any of the goal conditions or contradicts one of them.
+  bool regress_goal(const Planner &planner, size_t act, const WorldState &goal, WorldState &res);
 
-  float make_plan(const Planner &planner, const WorldState &from, const WorldState &to, std::vector<PlanStep> &plan);
+  float make_plan(const Planner &planner, const WorldState &from, const WorldState &to, std::vector<PlanStep> &plan,
+                  PlanSearch search = PlanSearch::Forward);
   void print_plan(const Planner &planner, const WorldState &init, const std::vector<PlanStep> &plan);
 };
 
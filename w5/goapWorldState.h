@@ -1,11 +1,65 @@
 #pragma once
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <string>
 
 namespace goap
 {
-  using WorldState = std::vector<int8_t>;
+  // Variables are int8_t packed one per byte, eight to a word, so states live inline and
+  // actions test and apply them word by word with masks.
+  constexpr size_t max_world_vars = 32;
+  using WorldWords = std::array<uint64_t, max_world_vars / 8>;
+
+  inline int8_t get_lane(const WorldWords &words, size_t i)
+  {
+    return int8_t(uint8_t(words[i / 8] >> (i % 8 * 8)));
+  }
+
+  inline void set_lane(WorldWords &words, size_t i, int8_t val)
+  {
+    const size_t shift = i % 8 * 8;
+    words[i / 8] = (words[i / 8] & ~(uint64_t(0xff) << shift)) | uint64_t(uint8_t(val)) << shift;
+  }
+
+  // bytewise add without carries between lanes, every lane wraps like int8_t
+  inline uint64_t add_lanes(uint64_t a, uint64_t b)
+  {
+    constexpr uint64_t high = 0x8080808080808080ull;
+    return ((a & ~high) + (b & ~high)) ^ ((a ^ b) & high);
+  }
+
+  inline uint64_t sub_lanes(uint64_t a, uint64_t b)
+  {
+    return add_lanes(a, add_lanes(~b, 0x0101010101010101ull));
+  }
+
+  struct WorldState
+  {
+    WorldWords words = {};
+    uint32_t count = 0; // lanes past count stay zero
+
+    size_t size() const { return count; }
+    int8_t operator[](size_t i) const { return get_lane(words, i); }
+    void set(size_t i, int8_t val) { set_lane(words, i, val); }
+
+    bool operator==(const WorldState &rhs) const = default;
+  };
+
   using WorldDesc = std::unordered_map<std::string, size_t>;
-};
 
+  inline uint64_t hash_state(const WorldState &ws)
+  {
+    uint64_t h = ws.count;
+    for (uint64_t w : ws.words)
+    {
+      // splitmix64 finalizer over the running value
+      h = (h ^ w) + 0x9e3779b97f4a7c15ull;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+      h ^= h >> 31;
+    }
+    return h;
+  }
+};
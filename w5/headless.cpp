@@ -0,0 +1,69 @@
+// runs the turn pipeline without a window, handy for profiling large worlds
+#include <flecs.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "dungeonGen.h"
+#include "dungeonUtils.h"
+#include "rng.h"
+#include "scriptedInput.h"
+#include "workerPool.h"
+
+// usage: hw5_headless [dungeon_size] [num_monsters] [num_frames] [script] [num_workers]
+int main(int argc, const char **argv)
+{
+  const size_t dungSize = argc > 1 ? size_t(atoi(argv[1])) : 50;
+  size_t numMonsters = argc > 2 ? size_t(atoi(argv[2])) : 0;
+  const size_t numFrames = argc > 3 ? size_t(atoi(argv[3])) : 1000;
+  ScriptedInput input(argc > 4 ? argv[4] : "RRDDLLUU..");
+  const size_t numWorkers = argc > 5 ? size_t(atoi(argv[5])) : std::thread::hardware_concurrency();
+
+  rng::seed(42);
+  jobs::set_num_workers(numWorkers);
+
+  flecs::world ecs;
+  {
+    std::vector<char> tiles(dungSize * dungSize);
+    gen_drunk_dungeon(tiles.data(), dungSize, dungSize);
+    size_t numFloor = 0;
+    for (char tile : tiles)
+      numFloor += tile == dungeon::floor ? 1 : 0;
+    // leave some room to move around, free tile search never gives up otherwise
+    numMonsters = std::min(numMonsters, numFloor / 2);
+    init_dungeon(ecs, tiles.data(), dungSize, dungSize);
+  }
+  init_roguelike(ecs);
+  add_monster_horde(ecs, numMonsters);
+
+  using clock = std::chrono::steady_clock;
+  double turnsTime = 0.0;
+  const auto start = clock::now();
+  for (size_t i = 0; i < numFrames; ++i)
+  {
+    apply_player_input(ecs, input.next());
+    const auto turnStart = clock::now();
+    process_turn(ecs);
+    turnsTime += std::chrono::duration<double, std::milli>(clock::now() - turnStart).count();
+    ecs.progress();
+  }
+  const double totalTime = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+  int turns = 0;
+  ecs.query<const TurnCounter>().each([&](const TurnCounter &tc) { turns = tc.count; });
+  // compare it between runs with different worker counts, it must not change
+  uint64_t stateHash = 0;
+  ecs.query<const Position, const Hitpoints>().each([&](flecs::entity e, const Position &pos, const Hitpoints &hp)
+  {
+    stateHash += (e.id() * 31 + uint64_t(pos.y * 4096 + pos.x)) * 31 + uint64_t(hp.hitpoints * 100.f);
+  });
+  printf("monsters: %zu, frames: %zu, turns: %d, workers: %zu\n", numMonsters, numFrames, turns, jobs::num_workers());
+  printf("process_turn: %.3f ms total, %.3f ms per turn\n", turnsTime, turns > 0 ? turnsTime / turns : 0.0);
+  printf("total: %.3f ms\n", totalTime);
+  printf("state hash: %016llx\n", (unsigned long long)stateHash);
+  return 0;
+}
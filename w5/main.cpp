@@ -4,217 +4,31 @@
 #include <algorithm>
 #include "ecsTypes.h"
 #include "roguelike.h"
+#include "roguelikeRender.h"
 #include "dungeonGen.h"
-#include "goapPlanner.h"
-
-enum EnemyDist
-{
-  DistMelee = 0,
-  DistRanged,
-  DistFar
-};
-
-enum HealthState
-{
-  Dead = 0,
-  Injured,
-  Healthy
-};
+#include "goapDomains.h"
+#include "rng.h"
+#include <chrono>
 
 static void debug_enemy_planner()
 {
-  goap::Planner pl = goap::create_planner();
-
-  goap::add_states_to_planner(pl,
-      {"enemy_vis",
-       "enemy_alive",
-       "have_melee",
-       "have_ranged",
-       "enemy_dist",
-       "health_state"});
-
-  goap::add_action_to_planner(pl, "wander", 1,
-      {{"health_state", Healthy}},
-      {{"enemy_vis", 1}},
-      {});
-
-  goap::add_action_to_planner(pl, "approach_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", -1}});
-
-  goap::add_action_to_planner(pl, "flee_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", +1}});
-
-  goap::add_action_to_planner(pl, "find_melee", 1,
-      {{"have_melee", 0}, {"health_state", Healthy}, {"enemy_vis", 0}},
-      {{"have_melee", 1}},
-      {});
-
-  /*
-  goap::add_action_to_planner(pl, "find_ranged", 1,
-      {{"have_ranged", 0}, {"health_state", Healthy}},
-      {{"have_ranged", 1}},
-      {});
-      */
-
-  goap::add_action_to_planner(pl, "patch_up", 1,
-      {{"health_state", Injured}},
-      {},
-      {{"health_state", +1}});
-
-  goap::add_action_to_planner(pl, "attack_enemy", 1,
-      {{"enemy_vis", 1}, {"enemy_alive", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
-      {{"enemy_alive", 0}},
-      {{"health_state", -1}});
-
-  goap::add_action_to_planner(pl, "shoot_enemy", 1,
-      {{"enemy_vis", 1}, {"enemy_alive", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
-      {{"enemy_alive", 0}},
-      {});
-
-  {
-    goap::WorldState ws = goap::produce_planner_worldstate(pl,
-        {{"enemy_vis", 0},
-         {"enemy_alive", 1},
-         {"have_melee", 0},
-         {"have_ranged", 0},
-         {"enemy_dist", DistFar},
-         {"health_state", Healthy}});
-
-    goap::WorldState goal = goap::produce_planner_worldstate(pl,
-        {{"enemy_alive", 0}, {"health_state", Healthy}});
-
-    std::vector<goap::PlanStep> plan;
-    goap::make_plan(pl, ws, goal, plan);
-    goap::print_plan(pl, ws, plan);
-  }
+  goap::Planner pl = create_enemy_debug_planner();
+  for (const GoapProblem &problem : enemy_debug_problems(pl))
   {
-    goap::WorldState ws = goap::produce_planner_worldstate(pl,
-        {{"enemy_vis", 1},
-         {"enemy_alive", 1},
-         {"have_melee", 0},
-         {"have_ranged", 0},
-         {"enemy_dist", DistMelee},
-         {"health_state", Injured}});
-
-    goap::WorldState goal = goap::produce_planner_worldstate(pl,
-        {{"enemy_alive", 0}, {"health_state", Healthy}, {"enemy_dist", DistFar}});
-
     std::vector<goap::PlanStep> plan;
-    goap::make_plan(pl, ws, goal, plan);
-    goap::print_plan(pl, ws, plan);
+    goap::make_plan(pl, problem.from, problem.to, plan);
+    goap::print_plan(pl, problem.from, plan);
   }
 }
 
 static void debug_looter_planner()
 {
-  goap::Planner pl = goap::create_planner();
-
-  goap::add_states_to_planner(pl,
-      {"enemy_vis",
-       "loot_vis",
-       "num_loot",
-       "have_melee",
-       "have_ranged",
-       "enemy_dist",
-       "health_state",
-       "escaped",
-       "blessed"});
-
-  goap::add_action_to_planner(pl, "open_room", 1,
-      {{"health_state", Healthy}},
-      {{"enemy_vis", 1}, {"loot_vis", 1}, {"enemy_dist", 2}},
-      {});
-
-  /*
-  goap::add_action_to_planner(pl, "pray", 1,
-      {{"health_state", Healthy}},
-      {},
-      {{"blessed", +1}});
-      */
-
-  goap::add_action_to_planner(pl, "loot", 1,
-      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}},
-      {{"loot_vis", 0}},
-      {{"num_loot", +1}});
-
-  goap::add_action_to_planner(pl, "loot_blessed", 1,
-      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}, {"blessed", 5}},
-      {{"loot_vis", 0}},
-      {{"num_loot", +2}});
-
-
-  goap::add_action_to_planner(pl, "loot_dang", 1,
-      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 1}},
-      {{"loot_vis", 0}},
-      {{"num_loot", +1}, {"health_state", -1}});
-
-
-  goap::add_action_to_planner(pl, "approach_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", -1}});
-
-  goap::add_action_to_planner(pl, "flee_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", +1}});
-
-  goap::add_action_to_planner(pl, "find_melee", 1,
-      {{"have_melee", 0}, {"health_state", Healthy}},
-      {{"have_melee", 1}},
-      {});
-
-  goap::add_action_to_planner(pl, "find_ranged", 1,
-      {{"have_ranged", 0}, {"health_state", Healthy}},
-      {{"have_ranged", 1}},
-      {});
-
-  goap::add_action_to_planner(pl, "patch_up", 1,
-      {{"health_state", Injured}},
-      {},
-      {{"health_state", +1}});
-
-  goap::add_action_to_planner(pl, "attack_enemy", 1,
-      {{"enemy_vis", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
-      {{"enemy_vis", 0}},
-      {{"health_state", -1}});
-
-  goap::add_action_to_planner(pl, "shoot_enemy", 1,
-      {{"enemy_vis", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
-      {{"enemy_vis", 0}},
-      {});
-
-  goap::add_action_to_planner(pl, "hide", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {{"enemy_vis", 0}},
-      {});
-
-  goap::add_action_to_planner(pl, "escape", 1,
-      {{"health_state", Healthy}, {"num_loot", 5}},
-      {{"escaped", 1}},
-      {});
-
-  goap::WorldState ws = goap::produce_planner_worldstate(pl,
-      {{"enemy_vis", 0},
-       {"loot_vis", 1},
-       {"num_loot", 0},
-       {"have_melee", 1},
-       {"have_ranged", 1},
-       {"enemy_dist", DistFar},
-       {"health_state", Healthy},
-       {"escaped", 0},
-       {"blessed", 0}});
-
-  goap::WorldState goal = goap::produce_planner_worldstate(pl,
-      {{"num_loot", 5}, {"escaped", 1}, {"health_state", Healthy}});
+  goap::Planner pl = create_looter_debug_planner();
+  const GoapProblem problem = looter_debug_problems(pl).front();
 
   std::vector<goap::PlanStep> plan;
-  goap::make_plan(pl, ws, goal, plan);
-  goap::print_plan(pl, ws, plan);
+  goap::make_plan(pl, problem.from, problem.to, plan);
+  goap::print_plan(pl, problem.from, plan);
 
   for (goap::PlanStep step : plan)
     printf("%d, ", step.action);
@@ -248,6 +62,8 @@ int main(int /*argc*/, const char ** /*argv*/)
     SetWindowSize(width, height);
   }
 
+  rng::seed(unsigned(std::chrono::system_clock::now().time_since_epoch().count()));
+
   flecs::world ecs;
   {
     constexpr size_t dungWidth = 50;
@@ -256,6 +72,8 @@ int main(int /*argc*/, const char ** /*argv*/)
     gen_drunk_dungeon(tiles, dungWidth, dungHeight);
     init_dungeon(ecs, tiles, dungWidth, dungHeight);
   }
+  init_dungeon_render(ecs);
+  init_roguelike_render(ecs);
   init_roguelike(ecs);
   //debug_enemy_planner();
   debug_looter_planner();
@@ -269,6 +87,7 @@ int main(int /*argc*/, const char ** /*argv*/)
   SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
   while (!WindowShouldClose())
   {
+    apply_player_input(ecs, read_keyboard_input());
     process_turn(ecs);
     update_camera(camera, ecs);
 
@@ -28,8 +28,9 @@ static Position find_free_dungeon_tile(flecs::world &ecs)
   return {0, 0};
 }
 
-flecs::entity create_monster(flecs::world &ecs, Color col, const char *texture_src)
+flecs::entity create_monster(flecs::world &ecs, Tint col, const char *texture_src)
 {
+  static auto schema = std::make_shared<BlackboardSchema>();
   Position pos = find_free_dungeon_tile(ecs);
 
   flecs::entity textureSrc = ecs.entity(texture_src);
@@ -38,12 +39,12 @@ flecs::entity create_monster(flecs::world &ecs, Color col, const char *texture_s
     .set(MovePos{pos.x, pos.y})
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
-    .set(Color{col})
+    .set(Tint{col})
     .add<TextureSource>(textureSrc)
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f})
-    .set(Blackboard{});
+    .set(Blackboard{schema});
 }
 
 void create_player(flecs::world &ecs, const char *texture_src)
@@ -60,7 +61,7 @@ void create_player(flecs::world &ecs, const char *texture_src)
     .set(Team{0})
     .set(PlayerInput{})
     .set(NumActions{2, 0})
-    .set(Color{255, 255, 255, 255})
+    .set(Tint{255, 255, 255, 255})
     .add<TextureSource>(textureSrc)
     .set(MeleeDamage{50.f});
 }
@@ -70,7 +71,7 @@ void create_heal(flecs::world &ecs, int x, int y, float amount)
   ecs.entity()
     .set(Position{x, y})
     .set(HealAmount{amount})
-    .set(Color{0xff, 0x44, 0x44, 0xff});
+    .set(Tint{0xff, 0x44, 0x44, 0xff});
 }
 
 void create_powerup(flecs::world &ecs, int x, int y, float amount)
@@ -78,6 +79,6 @@ void create_powerup(flecs::world &ecs, int x, int y, float amount)
   ecs.entity()
     .set(Position{x, y})
     .set(PowerupAmount{amount})
-    .set(Color{0xff, 0xff, 0x00, 0xff});
+    .set(Tint{0xff, 0xff, 0x00, 0xff});
 }
 
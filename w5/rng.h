@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// deterministic replacement for raylib's GetRandomValue, usable without a window
+namespace rng
+{
+  void seed(unsigned seed);
+  int range(int min, int max); // inclusive on both ends, same as GetRandomValue
+
+  // Reseeds the calling thread's generator from the global seed and a key (e.g. turn + entity id).
+  // Draws made after it don't depend on which thread runs the decision or in what order.
+  void select_stream(uint64_t key);
+};
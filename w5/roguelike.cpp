@@ -1,157 +1,51 @@
 #include "roguelike.h"
 #include "ecsTypes.h"
-#include "raylib.h"
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "occupancyIndex.h"
 #include "blackboard.h"
 #include "math.h"
 #include "dungeonUtils.h"
 #include "dijkstraMapGen.h"
 #include "dmapFollower.h"
+#include "aiUtils.h"
+#include "rng.h"
+#include "workerPool.h"
 #include "dmapBeh.h"
 #include "rlikeObjects.h"
+#include <tuple>
 
 
-static void register_roguelike_systems(flecs::world &ecs)
+void apply_player_input(flecs::world &ecs, const PlayerInput &keys)
 {
-  ecs.system<PlayerInput, Action, const IsPlayer>()
-    .each([&](PlayerInput &inp, Action &a, const IsPlayer)
-    {
-      bool left = IsKeyDown(KEY_LEFT);
-      bool right = IsKeyDown(KEY_RIGHT);
-      bool up = IsKeyDown(KEY_UP);
-      bool down = IsKeyDown(KEY_DOWN);
-      if (left && !inp.left)
-        a.action = EA_MOVE_LEFT;
-      if (right && !inp.right)
-        a.action = EA_MOVE_RIGHT;
-      if (up && !inp.up)
-        a.action = EA_MOVE_UP;
-      if (down && !inp.down)
-        a.action = EA_MOVE_DOWN;
-      inp.left = left;
-      inp.right = right;
-      inp.up = up;
-      inp.down = down;
-
-      bool pass = IsKeyDown(KEY_SPACE);
-      if (pass && !inp.passed)
-        a.action = EA_PASS;
-      inp.passed = pass;
-    });
-  ecs.system<const Position, const Color>()
-    .with<TextureSource>(flecs::Wildcard)
-    .with<BackgroundTile>()
-    .each([&](flecs::entity e, const Position &pos, const Color color)
-    {
-      const auto textureSrc = e.target<TextureSource>();
-      DrawTextureQuad(*textureSrc.get<Texture2D>(),
-          Vector2{1, 1}, Vector2{0, 0},
-          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, color);
-    });
-  ecs.system<const Position, const Color>()
-    .without<TextureSource>(flecs::Wildcard)
-    .each([&](const Position &pos, const Color color)
-    {
-      const Rectangle rect = {float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size};
-      DrawRectangleRec(rect, color);
-    });
-  ecs.system<const Position, const Color>()
-    .with<TextureSource>(flecs::Wildcard)
-    .without<BackgroundTile>()
-    .each([&](flecs::entity e, const Position &pos, const Color color)
-    {
-      const auto textureSrc = e.target<TextureSource>();
-      DrawTextureQuad(*textureSrc.get<Texture2D>(),
-          Vector2{1, 1}, Vector2{0, 0},
-          Rectangle{float(pos.x) * tile_size, float(pos.y) * tile_size, tile_size, tile_size}, color);
-    });
-  ecs.system<const Position, const Hitpoints>()
-    .each([&](const Position &pos, const Hitpoints &hp)
-    {
-      constexpr float hpPadding = 0.05f;
-      const float hpWidth = 1.f - 2.f * hpPadding;
-      const Rectangle underRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
-                                   hpWidth * tile_size, 0.1f * tile_size};
-      DrawRectangleRec(underRect, BLACK);
-      const Rectangle hpRect = {float(pos.x + hpPadding) * tile_size, float(pos.y-0.25f) * tile_size,
-                                hp.hitpoints / 100.f * hpWidth * tile_size, 0.1f * tile_size};
-      DrawRectangleRec(hpRect, RED);
-    });
-
-  ecs.system<Texture2D>()
-    .each([&](Texture2D &tex)
-    {
-      SetTextureFilter(tex, TEXTURE_FILTER_POINT);
-    });
-  ecs.system<const DmapWeights>()
-    .with<VisualiseMap>()
-    .each([&](const DmapWeights &wt)
-    {
-      auto dungeonDataQuery = ecs.query<const DungeonData>();
-      dungeonDataQuery.each([&](const DungeonData &dd)
-      {
-        for (size_t y = 0; y < dd.height; ++y)
-          for (size_t x = 0; x < dd.width; ++x)
-          {
-            float sum = 0.f;
-            for (const auto &pair : wt.weights)
-            {
-              ecs.entity(pair.first.c_str()).get([&](const DijkstraMapData &dmap)
-              {
-                float v = dmap.map[y * dd.width + x];
-                if (v < 1e5f)
-                  sum += powf(v * pair.second.mult, pair.second.pow);
-                else
-                  sum += v;
-              });
-            }
-            if (sum < 1e5f)
-              DrawText(TextFormat("%.1f", sum),
-                  int((float(x) + 0.2f) * tile_size), int((float(y) + 0.5f) * tile_size), 150, WHITE);
-          }
-      });
-    });
-  ecs.system<const DijkstraMapData>()
-    .with<VisualiseMap>()
-    .each([&](const DijkstraMapData &dmap)
-    {
-      auto dungeonDataQuery = ecs.query<const DungeonData>();
-      dungeonDataQuery.each([&](const DungeonData &dd)
-      {
-        for (size_t y = 0; y < dd.height; ++y)
-          for (size_t x = 0; x < dd.width; ++x)
-          {
-            const float val = dmap.map[y * dd.width + x];
-            if (val < 1e5f)
-              DrawText(TextFormat("%.1f", val),
-                  int((float(x) + 0.2f) * tile_size), int((float(y) + 0.5f) * tile_size), 150, WHITE);
-          }
-      });
-    });
+  auto playerInputQuery = ecs.query<PlayerInput, Action, const IsPlayer>();
+  playerInputQuery.each([&](PlayerInput &inp, Action &a, const IsPlayer)
+  {
+    if (keys.left && !inp.left)
+      a.action = EA_MOVE_LEFT;
+    if (keys.right && !inp.right)
+      a.action = EA_MOVE_RIGHT;
+    if (keys.up && !inp.up)
+      a.action = EA_MOVE_UP;
+    if (keys.down && !inp.down)
+      a.action = EA_MOVE_DOWN;
+    inp.left = keys.left;
+    inp.right = keys.right;
+    inp.up = keys.up;
+    inp.down = keys.down;
+
+    if (keys.passed && !inp.passed)
+      a.action = EA_PASS;
+    inp.passed = keys.passed;
+  });
 }
 
-
 void init_roguelike(flecs::world &ecs)
 {
-  register_roguelike_systems(ecs);
-
-  ecs.entity("swordsman_tex")
-    .set(Texture2D{LoadTexture("assets/swordsman.png")});
-  ecs.entity("minotaur_tex")
-    .set(Texture2D{LoadTexture("assets/minotaur.png")});
-
-  ecs.observer<Texture2D>()
-    .event(flecs::OnRemove)
-    .each([](Texture2D texture)
-      {
-        UnloadTexture(texture);
-      });
-
-  create_hive_monster(create_monster(ecs, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
-  create_hive_monster(create_monster(ecs, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
-  create_hive_monster(create_monster(ecs, Color{0x11, 0x11, 0x11, 0xff}, "minotaur_tex"));
-  create_hive(create_player_fleer(create_monster(ecs, Color{0, 255, 0, 255}, "minotaur_tex")));
+  create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
+  create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
+  create_hive_monster(create_monster(ecs, Tint{0x11, 0x11, 0x11, 0xff}, "minotaur_tex"));
+  create_hive(create_player_fleer(create_monster(ecs, Tint{0, 255, 0, 255}, "minotaur_tex")));
 
   create_player(ecs, "swordsman_tex");
 
@@ -160,13 +54,14 @@ void init_roguelike(flecs::world &ecs)
     .set(ActionLog{});
 }
 
-void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
+void add_monster_horde(flecs::world &ecs, size_t num_monsters)
 {
-  flecs::entity wallTex = ecs.entity("wall_tex")
-    .set(Texture2D{LoadTexture("assets/wall.png")});
-  flecs::entity floorTex = ecs.entity("floor_tex")
-    .set(Texture2D{LoadTexture("assets/floor.png")});
+  for (size_t i = 0; i < num_monsters; ++i)
+    create_hive_monster(create_monster(ecs, Tint{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
+}
 
+void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
+{
   std::vector<char> dungeonData;
   dungeonData.resize(w * h);
   for (size_t y = 0; y < h; ++y)
@@ -174,20 +69,6 @@ void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
       dungeonData[y * w + x] = tiles[y * w + x];
   ecs.entity("dungeon")
     .set(DungeonData{dungeonData, w, h});
-
-  for (size_t y = 0; y < h; ++y)
-    for (size_t x = 0; x < w; ++x)
-    {
-      char tile = tiles[y * w + x];
-      flecs::entity tileEntity = ecs.entity()
-        .add<BackgroundTile>()
-        .set(Position{int(x), int(y)})
-        .set(Color{255, 255, 255, 255});
-      if (tile == dungeon::wall)
-        tileEntity.add<TextureSource>(wallTex);
-      else if (tile == dungeon::floor)
-        tileEntity.add<TextureSource>(floorTex);
-    }
 }
 
 
@@ -243,6 +124,7 @@ static void process_actions(flecs::world &ecs)
   auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
   auto processHeals = ecs.query<Action, Hitpoints>();
   auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
+  OccupancyIndex occupancy;
   // Process all actions
   ecs.defer([&]
   {
@@ -255,26 +137,34 @@ static void process_actions(flecs::world &ecs)
       hp.hitpoints += 10.f;
 
     });
+    occupancy.clear();
+    checkAttacks.each([&](flecs::entity entity, const MovePos &mpos, Hitpoints &hp, const Team &team)
+    {
+      occupancy.add(mpos, {entity, &hp, team.team});
+    });
     processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
     {
       Position nextPos = move_pos(pos, a.action);
       bool blocked = !dungeon::is_tile_walkable(ecs, nextPos);
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      occupancy.each(nextPos, [&](OccupancyIndex::Occupant &occ)
       {
-        if (entity != enemy && epos == nextPos)
+        if (occ.entity != entity)
         {
           blocked = true;
-          if (team.team != enemy_team.team)
+          if (team.team != occ.team)
           {
             push_to_log(ecs, "damaged entity");
-            hp.hitpoints -= dmg.damage;
+            occ.hp->hitpoints -= dmg.damage;
           }
         }
       });
       if (blocked)
         a.action = EA_NOP;
       else
+      {
+        occupancy.move(entity, mpos, nextPos);
         mpos = nextPos;
+      }
     });
     // now move
     processActions.each([&](Action &a, Position &pos, MovePos &mpos, const MeleeDamage &, const Team&)
@@ -322,10 +212,10 @@ static void process_actions(flecs::world &ecs)
 }
 
 template<typename T>
-static void push_info_to_bb(Blackboard &bb, const char *name, const T &val)
+static void push_info_to_bb(Blackboard &bb, size_t key, const T &val)
 {
-  size_t idx = bb.regName<T>(name);
-  bb.set(idx, val);
+  bb.regKey<T>(key);
+  bb.set(key, val);
 }
 
 // sensors
@@ -336,11 +226,13 @@ static void gather_world_info(flecs::world &ecs)
                                           const WorldInfoGatherer,
                                           const Team>();
   auto alliesQuery = ecs.query<const Position, const Team>();
+  static const size_t hpBb = bb_key<float>("hp");
+  static const size_t alliesNumBb = bb_key<float>("alliesNum");
+  static const size_t enemyDistBb = bb_key<float>("enemyDist");
   gatherWorldInfo.each([&](Blackboard &bb, const Position &pos, const Hitpoints &hp,
                            WorldInfoGatherer, const Team &team)
   {
-    // first gather all needed names (without cache)
-    push_info_to_bb(bb, "hp", hp.hitpoints);
+    push_info_to_bb(bb, hpBb, hp.hitpoints);
     float numAllies = 0; // note float
     float closestEnemyDist = 100.f;
     alliesQuery.each([&](const Position &apos, const Team &ateam)
@@ -355,15 +247,75 @@ static void gather_world_info(flecs::world &ecs)
           closestEnemyDist = enemyDist;
       }
     });
-    push_info_to_bb(bb, "alliesNum", numAllies);
-    push_info_to_bb(bb, "enemyDist", closestEnemyDist);
+    push_info_to_bb(bb, alliesNumBb, numAllies);
+    push_info_to_bb(bb, enemyDistBb, closestEnemyDist);
   });
 }
 
-void process_turn(flecs::world &ecs)
+template<typename Callable>
+static void run_on_stages(flecs::world &ecs, size_t count, Callable c)
+{
+  const size_t numWorkers = jobs::num_workers();
+  ecs.readonly_begin(numWorkers > 1);
+  jobs::parallel_for(count, [&](size_t worker, size_t begin, size_t end)
+  {
+    flecs::world stage = ecs.get_stage(int32_t(worker));
+    for (size_t i = begin; i < end; ++i)
+      c(stage, i);
+  });
+  ecs.readonly_end();
+}
+
+// Decisions only read the world and write components of their own entity. They run on
+// worker stages in readonly mode, so every NPC sees the same frozen world and the writes
+// are merged afterwards. Random draws are keyed per entity and turn, so the outcome
+// doesn't depend on the number of workers.
+static void plan_npc_actions(flecs::world &ecs)
 {
   auto stateMachineAct = ecs.query<StateMachine>();
   auto behTreeUpdate = ecs.query<BehaviourTree, Blackboard>();
+  auto turnQuery = ecs.query<const TurnCounter>();
+
+  uint64_t turn = 0;
+  turnQuery.each([&](const TurnCounter &tc) { turn = uint64_t(tc.count); });
+  auto select_rng_stream = [&](flecs::entity e)
+  {
+    rng::select_stream(turn * 0x9e3779b97f4a7c15ull ^ e.id());
+  };
+
+  team_positions_query(ecs); // shared queries can't be created from worker stages
+  const int32_t numStages = int32_t(jobs::num_workers());
+  if (ecs.get_stage_count() != numStages)
+    ecs.set_stage_count(numStages);
+
+  // component pointers stay valid while the world is readonly
+  std::vector<std::pair<flecs::entity, StateMachine*>> machines;
+  stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
+  {
+    machines.emplace_back(e, &sm);
+  });
+  run_on_stages(ecs, machines.size(), [&](flecs::world &stage, size_t i)
+  {
+    select_rng_stream(machines[i].first);
+    machines[i].second->act(0.f, stage, machines[i].first.mut(stage));
+  });
+
+  // gathered after the merge, it may have moved entities between tables
+  std::vector<std::tuple<flecs::entity, BehaviourTree*, Blackboard*>> trees;
+  behTreeUpdate.each([&](flecs::entity e, BehaviourTree &bt, Blackboard &bb)
+  {
+    trees.emplace_back(e, &bt, &bb);
+  });
+  run_on_stages(ecs, trees.size(), [&](flecs::world &stage, size_t i)
+  {
+    auto [e, bt, bb] = trees[i];
+    select_rng_stream(e);
+    bt->update(stage, e.mut(stage), *bb);
+  });
+}
+
+void process_turn(flecs::world &ecs)
+{
   auto turnIncrementer = ecs.query<TurnCounter>();
   if (is_player_acted(ecs))
   {
@@ -371,36 +323,19 @@ void process_turn(flecs::world &ecs)
     {
       // Plan action for NPCs
       gather_world_info(ecs);
-      ecs.defer([&]
-      {
-        stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
-        {
-          sm.act(0.f, ecs, e);
-        });
-        behTreeUpdate.each([&](flecs::entity e, BehaviourTree &bt, Blackboard &bb)
-        {
-          bt.update(ecs, e, bb);
-        });
-        process_dmap_followers(ecs);
-      });
+      plan_npc_actions(ecs);
+      process_dmap_followers(ecs);
       turnIncrementer.each([](TurnCounter &tc) { tc.count++; });
     }
     process_actions(ecs);
 
-    std::vector<float> approachMap;
-    dmaps::gen_player_approach_map(ecs, approachMap);
-    ecs.entity("approach_map")
-      .set(DijkstraMapData{approachMap});
-
-    std::vector<float> fleeMap;
-    dmaps::gen_player_flee_map(ecs, fleeMap);
-    ecs.entity("flee_map")
-      .set(DijkstraMapData{fleeMap});
-
-    std::vector<float> hiveMap;
-    dmaps::gen_hive_pack_map(ecs, hiveMap);
-    ecs.entity("hive_map")
-      .set(DijkstraMapData{hiveMap});
+    // approach and hive maps persist between turns and are only repaired around
+    // sources that moved, the flee map is seeded everywhere and gets rebuilt
+    dmaps::gen_maps(ecs, {
+      {ecs.entity("approach_map"), dmaps::MapKind::PlayerApproach},
+      {ecs.entity("flee_map"), dmaps::MapKind::PlayerFlee},
+      {ecs.entity("hive_map"), dmaps::MapKind::HivePack}
+    });
 
     //ecs.entity("flee_map").add<VisualiseMap>();
     ecs.entity("hive_follower_sum")
@@ -408,25 +343,3 @@ void process_turn(flecs::world &ecs)
       .add<VisualiseMap>();
   }
 }
-
-void print_stats(flecs::world &ecs)
-{
-  auto playerStatsQuery = ecs.query<const IsPlayer, const Hitpoints, const MeleeDamage>();
-  playerStatsQuery.each([&](const IsPlayer &, const Hitpoints &hp, const MeleeDamage &dmg)
-  {
-    DrawText(TextFormat("hp: %d", int(hp.hitpoints)), 20, 20, 20, WHITE);
-    DrawText(TextFormat("power: %d", int(dmg.damage)), 20, 40, 20, WHITE);
-  });
-
-  auto actionLogQuery = ecs.query<const ActionLog>();
-  actionLogQuery.each([&](const ActionLog &l)
-  {
-    int yPos = GetRenderHeight() - 20;
-    for (const std::string &msg : l.log)
-    {
-      DrawText(msg.c_str(), 20, yPos, 20, WHITE);
-      yPos -= 20;
-    }
-  });
-}
-
@@ -1,10 +1,10 @@
 #pragma once
 
 #include <flecs.h>
-
-constexpr float tile_size = 512.f;
+#include "ecsTypes.h"
 
 void init_roguelike(flecs::world &ecs);
 void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h);
+void add_monster_horde(flecs::world &ecs, size_t num_monsters);
+void apply_player_input(flecs::world &ecs, const PlayerInput &keys);
 void process_turn(flecs::world &ecs);
-void print_stats(flecs::world &ecs);
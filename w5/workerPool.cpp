@@ -0,0 +1,114 @@
+#include "workerPool.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+  std::vector<std::thread> threads;
+  std::mutex mtx;
+  std::condition_variable startCv;
+  std::condition_variable doneCv;
+  const jobs::range_job *job = nullptr;
+  size_t count = 0;
+  size_t generation = 0;
+  size_t pending = 0;
+  bool quit = false;
+
+  std::pair<size_t, size_t> chunk(size_t worker) const
+  {
+    const size_t numWorkers = threads.size() + 1;
+    return {count * worker / numWorkers, count * (worker + 1) / numWorkers};
+  }
+
+  void workerLoop(size_t worker)
+  {
+    size_t seenGeneration = 0;
+    while (true)
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      startCv.wait(lock, [&]() { return quit || generation != seenGeneration; });
+      if (quit)
+        return;
+      seenGeneration = generation;
+      const auto [begin, end] = chunk(worker);
+      lock.unlock();
+
+      if (begin < end)
+        (*job)(worker, begin, end);
+
+      lock.lock();
+      if (--pending == 0)
+        doneCv.notify_one();
+    }
+  }
+
+public:
+  ~WorkerPool() { resize(1); }
+
+  size_t size() const { return threads.size() + 1; }
+
+  void resize(size_t num)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      quit = true;
+    }
+    startCv.notify_all();
+    for (std::thread &t : threads)
+      t.join();
+    threads.clear();
+    quit = false;
+    generation = 0;
+    for (size_t i = 1; i < num; ++i)
+      threads.emplace_back([this, i]() { workerLoop(i); });
+  }
+
+  void run(size_t in_count, const jobs::range_job &in_job)
+  {
+    if (threads.empty())
+    {
+      if (in_count > 0)
+        in_job(0, 0, in_count);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      job = &in_job;
+      count = in_count;
+      pending = threads.size();
+      generation++;
+    }
+    startCv.notify_all();
+
+    const auto [begin, end] = chunk(0);
+    if (begin < end)
+      in_job(0, begin, end);
+
+    std::unique_lock<std::mutex> lock(mtx);
+    doneCv.wait(lock, [&]() { return pending == 0; });
+    job = nullptr;
+  }
+};
+
+static WorkerPool &pool()
+{
+  static WorkerPool p;
+  return p;
+}
+
+void jobs::set_num_workers(size_t num)
+{
+  pool().resize(num > 0 ? num : 1);
+}
+
+size_t jobs::num_workers()
+{
+  return pool().size();
+}
+
+void jobs::parallel_for(size_t count, const range_job &job)
+{
+  pool().run(count, job);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Small persistent thread pool for per-turn data-parallel work.
+// Worker 0 is always the calling thread, so with a single worker everything runs inline.
+namespace jobs
+{
+  using range_job = std::function<void(size_t worker, size_t begin, size_t end)>;
+
+  void set_num_workers(size_t num);
+  size_t num_workers();
+
+  // splits [0, count) into contiguous chunks, one per worker, and blocks until all are done
+  void parallel_for(size_t count, const range_job &job);
+};